@@ -16,6 +16,8 @@ zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "hashblock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "hashtx")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "rawblock")
 zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "rawtx")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "hashtxremoved")
+zmqSubSocket.setsockopt(zmq.SUBSCRIBE, "hashblockdisconnected")
 zmqSubSocket.connect("tcp://127.0.0.1:%i" % port)
 
 try:
@@ -39,6 +41,12 @@ try:
         elif topic == "rawtx":
             print '- RAW TX ('+sequence+') -'
             print binascii.hexlify(body)
+        elif topic == "hashtxremoved":
+            print '- HASH TX REMOVED ('+sequence+') reason '+str(ord(body[32]))+' -'
+            print binascii.hexlify(body[:32])
+        elif topic == "hashblockdisconnected":
+            print '- HASH BLOCK DISCONNECTED ('+sequence+') height '+str(struct.unpack('<I', body[32:36])[0])+' -'
+            print binascii.hexlify(body[:32])
 
 except KeyboardInterrupt:
     zmqContext.destroy()
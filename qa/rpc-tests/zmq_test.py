@@ -29,13 +29,26 @@ class ZMQTest (BitcoinTestFramework):
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        # Subscriptions match topic prefixes, so the removal topics get a socket of their own
+        self.zmqSubSocketRemoval = self.zmqContext.socket(zmq.SUB)
+        self.zmqSubSocketRemoval.setsockopt(zmq.SUBSCRIBE, b"hashtxremoved")
+        self.zmqSubSocketRemoval.setsockopt(zmq.SUBSCRIBE, b"hashblockdisconnected")
+        self.zmqSubSocketRemoval.connect("tcp://127.0.0.1:%i" % self.port)
         return start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[
-            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port)],
+            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port),
+             '-zmqpubhashtxremoved=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblockdisconnected=tcp://127.0.0.1:'+str(self.port)],
             [],
             [],
             []
             ])
 
+    def recv_removal(self, topic, seq):
+        msg = self.zmqSubSocketRemoval.recv_multipart()
+        assert_equal(msg[0], topic)
+        msgSequence = struct.unpack('<I', msg[-1])[-1]
+        assert_equal(msgSequence, seq) #each topic counts its own messages from 0
+        return msg[1]
+
     def run_test(self):
         self.sync_all()
 
@@ -95,6 +108,33 @@ class ZMQTest (BitcoinTestFramework):
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        # mining the tx removes it from the mempool of node 0, because of a block
+        blkhash = self.nodes[1].generate(1)[0]
+        blkheight = self.nodes[1].getblockcount()
+        self.sync_all()
+        body = self.recv_removal(b"hashtxremoved", 0)
+        assert_equal(bytes_to_hex_str(body[:32]), hashRPC)
+        assert_equal(body[32], 4) #MemPoolRemovalReason::BLOCK
+
+        # invalidating the block disconnects it: its hash and LE32 height are published
+        self.nodes[0].invalidateblock(blkhash)
+        body = self.recv_removal(b"hashblockdisconnected", 0)
+        assert_equal(bytes_to_hex_str(body[:32]), blkhash)
+        assert_equal(struct.unpack('<I', body[32:])[0], blkheight)
+        assert(hashRPC in self.nodes[0].getrawmempool())
+
+        # reconnecting and disconnecting it again continues the sequence of each topic
+        self.nodes[0].reconsiderblock(blkhash)
+        body = self.recv_removal(b"hashtxremoved", 1)
+        assert_equal(bytes_to_hex_str(body[:32]), hashRPC)
+        assert_equal(body[32], 4)
+        self.nodes[0].invalidateblock(blkhash)
+        body = self.recv_removal(b"hashblockdisconnected", 1)
+        assert_equal(bytes_to_hex_str(body[:32]), blkhash)
+        self.nodes[0].reconsiderblock(blkhash)
+        self.recv_removal(b"hashtxremoved", 2)
+        self.sync_all()
+
 
 if __name__ == '__main__':
     ZMQTest ().main ()
@@ -0,0 +1,26 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "pubkey.h"
+#include "script/standard.h"
+
+bool GetAddressIndexHash(const CScript& scriptPubKey, int& type, uint160& hashBytes)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        type = ADDRESS_INDEX_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        type = ADDRESS_INDEX_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
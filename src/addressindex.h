@@ -0,0 +1,226 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Kinds of addresses kept in the address index */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_PUBKEYHASH = 1,  //!< Pay to a key hash (or to the key itself)
+    ADDRESS_INDEX_SCRIPTHASH = 2,  //!< Pay to a script hash
+};
+
+/** Get the address index type and hash of the address a script pays to, if it is indexed */
+bool GetAddressIndexHash(const CScript& scriptPubKey, int& type, uint160& hashBytes);
+
+/**
+ * Key of an address index entry: an output paying to, or an input spending from
+ * an address. Multi-byte integers are big-endian, so that the entries of an
+ * address are ordered by height and position in the block.
+ */
+struct CAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() : type(ADDRESS_INDEX_NONE), blockHeight(0), txindex(0), index(0), spending(false) {}
+
+    CAddressIndexKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn,
+                     const uint256& txhashIn, unsigned int indexIn, bool spendingIn) :
+        type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn), txindex(txindexIn),
+        txhash(txhashIn), index(indexIn), spending(spendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 66;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32be(s);
+        spending = ser_readdata8(s) != 0;
+    }
+};
+
+/** Prefix of the address index entries of an address, optionally from a given height on */
+struct CAddressIndexIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn) :
+        type(typeIn), hashBytes(hashBytesIn), fHeight(false), blockHeight(0) {}
+
+    CAddressIndexIteratorKey(unsigned int typeIn, const uint160& hashBytesIn, int blockHeightIn) :
+        type(typeIn), hashBytes(hashBytesIn), fHeight(true), blockHeight(blockHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return fHeight ? 25 : 21;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            ser_writedata32be(s, blockHeight);
+    }
+};
+
+/** Key of an unspent output paying to an address */
+struct CAddressUnspentKey {
+    unsigned int type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() : type(ADDRESS_INDEX_NONE), index(0) {}
+
+    CAddressUnspentKey(unsigned int typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) :
+        type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 57;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+};
+
+/** An unspent output paying to an address. A null value erases the entry. */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    CAddressUnspentValue() { SetNull(); }
+
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) :
+        satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    void SetNull() {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return satoshis == -1;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(blockHeight);
+    }
+};
+
+/** Key of a spent index entry: the output that was spent */
+struct CSpentIndexKey {
+    uint256 txid;
+    unsigned int outputIndex;
+
+    CSpentIndexKey() : outputIndex(0) {}
+
+    CSpentIndexKey(const uint256& txidIn, unsigned int outputIndexIn) :
+        txid(txidIn), outputIndex(outputIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(outputIndex);
+    }
+};
+
+/**
+ * The input that spent an output, with the value and address of the output.
+ * A block height of -1 means the spend is in the memory pool. A null value
+ * erases the entry.
+ */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int inputIndex;
+    int blockHeight;
+    CAmount satoshis;
+    int addressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() { SetNull(); }
+
+    CSpentIndexValue(const uint256& txidIn, unsigned int inputIndexIn, int blockHeightIn, CAmount satoshisIn,
+                     int addressTypeIn, const uint160& addressHashIn) :
+        txid(txidIn), inputIndex(inputIndexIn), blockHeight(blockHeightIn), satoshis(satoshisIn),
+        addressType(addressTypeIn), addressHash(addressHashIn) {}
+
+    void SetNull() {
+        txid.SetNull();
+        inputIndex = 0;
+        blockHeight = 0;
+        satoshis = 0;
+        addressType = ADDRESS_INDEX_NONE;
+        addressHash.SetNull();
+    }
+
+    bool IsNull() const {
+        return txid.IsNull();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txid);
+        READWRITE(inputIndex);
+        READWRITE(blockHeight);
+        READWRITE(satoshis);
+        READWRITE(addressType);
+        READWRITE(addressHash);
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
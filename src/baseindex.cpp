@@ -0,0 +1,164 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "baseindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "init.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+
+CBaseIndex::CBaseIndex() : fTipChanged(false), fSynced(false), fStopped(false), pindexBest(NULL), nLastLocatorWrite(0)
+{
+}
+
+void CBaseIndex::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    fTipChanged = true;
+    condTipChanged.notify_one();
+}
+
+const CBlockIndex* CBaseIndex::ReadBestBlock()
+{
+    LOCK(cs_main);
+    CBlockLocator locator;
+    if (ReadBestBlockLocator(locator))
+        return FindForkInGlobalIndex(chainActive, locator);
+    return GetInitialBestBlock();
+}
+
+void CBaseIndex::WriteBestBlock(const CBlockIndex* pindex)
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    if (!WriteBestBlockLocator(locator))
+        LogPrintf("%s: failed to write the best block of the %s\n", __func__, GetName());
+    nLastLocatorWrite = GetTime();
+}
+
+void CBaseIndex::SetBestBlock(const CBlockIndex* pindex, bool fSyncedIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    pindexBest = pindex;
+    fSynced = fSynced || fSyncedIn;
+    condBestBlock.notify_all();
+}
+
+void CBaseIndex::SetStopped()
+{
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    fStopped = true;
+    condBestBlock.notify_all();
+}
+
+bool CBaseIndex::IsSynced()
+{
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    return fSynced;
+}
+
+const CBlockIndex* CBaseIndex::GetBestBlock()
+{
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    return pindexBest;
+}
+
+bool CBaseIndex::BlockUntilSyncedToCurrentChain()
+{
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs_index);
+    if (!fSynced || !pindexTip)
+        return false;
+    while (!pindexBest || pindexBest->GetAncestor(pindexTip->nHeight) != pindexTip) {
+        // The index will not move any more
+        if (fStopped || ShutdownRequested())
+            return false;
+        condBestBlock.timed_wait(lock, boost::posix_time::milliseconds(100));
+    }
+    return true;
+}
+
+void CBaseIndex::ThreadSync()
+{
+    const CChainParams& chainparams = Params();
+    const CBlockIndex* pindex = ReadBestBlock();
+    const CBlockIndex* pindexWritten = NULL;
+    SetBestBlock(pindex, false);
+    LogPrintf("%s: %s starts at height %d\n", __func__, GetName(), pindex ? pindex->nHeight : -1);
+
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            {
+                boost::unique_lock<boost::mutex> lock(cs_index);
+                fTipChanged = false;
+            }
+
+            const CBlockIndex* pindexNext;
+            {
+                LOCK(cs_main);
+                // After a reorganization, continue from the fork point
+                pindex = chainActive.FindFork(pindex);
+                pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+            }
+
+            if (!pindexNext) {
+                if (!IsSynced())
+                    LogPrintf("%s: %s is synced at height %d\n", __func__, GetName(), pindex ? pindex->nHeight : -1);
+                SetBestBlock(pindex, true);
+                if (pindex && pindex != pindexWritten && (!pindexWritten || GetTime() - nLastLocatorWrite >= INDEX_LOCATOR_INTERVAL)) {
+                    WriteBestBlock(pindex);
+                    pindexWritten = pindex;
+                }
+
+                // Wait for the tip to move. UpdatedBlockTip is not signalled
+                // during initial block download, so check again every second.
+                boost::unique_lock<boost::mutex> lock(cs_index);
+                if (!fTipChanged)
+                    condTipChanged.timed_wait(lock, boost::posix_time::seconds(1));
+                continue;
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexNext, chainparams.GetConsensus())) {
+                LogPrintf("%s: failed to read block %s, %s stopped\n", __func__, pindexNext->GetBlockHash().ToString(), GetName());
+                SetStopped();
+                return;
+            }
+            if (!WriteBlock(block, pindexNext)) {
+                LogPrintf("%s: failed to write block %s, %s stopped\n", __func__, pindexNext->GetBlockHash().ToString(), GetName());
+                SetStopped();
+                return;
+            }
+            pindex = pindexNext;
+            SetBestBlock(pindex, false);
+
+            if (GetTime() - nLastLocatorWrite >= INDEX_LOCATOR_INTERVAL) {
+                if (!IsSynced())
+                    LogPrintf("%s: %s at height %d\n", __func__, GetName(), pindex->nHeight);
+                WriteBestBlock(pindex);
+                pindexWritten = pindex;
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (pindex && pindex != pindexWritten)
+            WriteBestBlock(pindex);
+        SetStopped();
+        throw;
+    }
+}
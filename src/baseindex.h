@@ -0,0 +1,81 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BASEINDEX_H
+#define BITCOIN_BASEINDEX_H
+
+#include "validationinterface.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+class CBlockIndex;
+struct CBlockLocator;
+
+/** Seconds between writes of an index's best block while it is catching up */
+static const int64_t INDEX_LOCATOR_INTERVAL = 30;
+
+/**
+ * Base of the optional indexes that are built on a background thread.
+ *
+ * The thread follows the active chain from the last block the index covers,
+ * reading each block back from disk, so connecting a block never waits for
+ * index writes. The last indexed block is stored with the index, which lets
+ * an index be switched on (or back on) at startup and catch up without a
+ * reindex. After a reorganization the thread continues from the fork point;
+ * what was written for the disconnected blocks is left in place.
+ */
+class CBaseIndex : public CValidationInterface
+{
+public:
+    CBaseIndex();
+    virtual ~CBaseIndex() {}
+
+    /** Index blocks until interrupted. Run on its own thread. */
+    void ThreadSync();
+
+    /** Whether the index has caught up with the active chain once */
+    bool IsSynced();
+
+    /** The last block the index covers */
+    const CBlockIndex* GetBestBlock();
+
+    /**
+     * Once the index has caught up, wait for it to cover the current tip, so
+     * that lookups see the latest blocks. Returns false if the index is still
+     * catching up or its thread has stopped. Must not be called with cs_main held.
+     */
+    bool BlockUntilSyncedToCurrentChain();
+
+protected:
+    // CValidationInterface
+    void UpdatedBlockTip(const CBlockIndex *pindex);
+
+    /** Name of the index, for the log */
+    virtual const char* GetName() const = 0;
+    /** The block the index covers before it has stored a best block. Called with cs_main held. */
+    virtual const CBlockIndex* GetInitialBestBlock() { return NULL; }
+    virtual bool ReadBestBlockLocator(CBlockLocator& locator) = 0;
+    virtual bool WriteBestBlockLocator(const CBlockLocator& locator) = 0;
+    /** Add a block of the active chain to the index */
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+private:
+    const CBlockIndex* ReadBestBlock();
+    void WriteBestBlock(const CBlockIndex* pindex);
+    void SetBestBlock(const CBlockIndex* pindex, bool fSyncedIn);
+    void SetStopped();
+
+    boost::mutex cs_index;
+    boost::condition_variable condTipChanged;
+    boost::condition_variable condBestBlock;
+    bool fTipChanged;
+    bool fSynced;
+    bool fStopped;
+    const CBlockIndex* pindexBest;
+    int64_t nLastLocatorWrite;
+};
+
+#endif // BITCOIN_BASEINDEX_H
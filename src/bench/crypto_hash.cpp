@@ -69,6 +69,22 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void SipHashBatch_32b(benchmark::State& state)
+{
+    std::vector<uint256> vals(1000);
+    std::vector<const uint256*> ptrs;
+    for (size_t i = 0; i < vals.size(); i++) {
+        *((uint64_t*)vals[i].begin()) = i;
+        ptrs.push_back(&vals[i]);
+    }
+    std::vector<uint64_t> out(vals.size());
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            SipHashUint256Batch(0, i, ptrs.data(), ptrs.size(), out.data());
+        }
+    }
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
@@ -76,3 +92,4 @@ BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(SipHashBatch_32b);
@@ -0,0 +1,308 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "main.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+/**
+ * Replays a synthetic transaction stream through the mempool: independent
+ * transactions, unconfirmed chains, CPFP packages and RBF replacements,
+ * interleaved with size limiting (TrimToSize) and block connection
+ * (removeForBlock). Besides the usual per-iteration numbers, the latency of
+ * each mempool operation is reported with its tail percentiles.
+ *
+ * Full AcceptToMemoryPool and BlockAssembler need a chainstate, so the
+ * mempool side of both is driven directly here: ancestor limit checks and
+ * addUnchecked for acceptance, and an ancestor feerate ordered selection of
+ * packages for block templates.
+ */
+
+namespace {
+
+/** Trim the pool to this many bytes of dynamic memory usage. */
+static const size_t REPLAY_MEMPOOL_LIMIT = 3 * 1000 * 1000;
+/** Connect a block after this many stream steps. */
+static const int REPLAY_BLOCK_INTERVAL = 1000;
+/** Maximum virtual size of the transactions taken into each block. */
+static const unsigned int REPLAY_BLOCK_SIZE = 100000;
+
+class LatencyStats
+{
+    std::string name;
+    std::vector<int64_t> samples;
+
+public:
+    LatencyStats(const std::string& _name) : name(_name) {}
+
+    void Add(int64_t nMicros) { samples.push_back(nMicros); }
+
+    /** Print in the bench CSV format, followed by one row per percentile. */
+    void Report()
+    {
+        if (samples.empty())
+            return;
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (size_t i = 0; i < samples.size(); i++)
+            total += samples[i];
+        std::cout << std::fixed << std::setprecision(15) << name << "," << samples.size() << ","
+                  << samples.front() * 0.000001 << "," << samples.back() * 0.000001 << ","
+                  << total / samples.size() * 0.000001 << "\n";
+        ReportPercentile("p50", 0.5);
+        ReportPercentile("p99", 0.99);
+        ReportPercentile("p99.9", 0.999);
+    }
+
+private:
+    void ReportPercentile(const char* pszLabel, double dFraction)
+    {
+        double p = samples[std::min(samples.size() - 1, (size_t)(dFraction * samples.size()))] * 0.000001;
+        std::cout << name << "-" << pszLabel << ",1," << p << "," << p << "," << p << "\n";
+    }
+};
+
+class MempoolReplayer
+{
+    CTxMemPool& pool;
+    unsigned int nHeight;
+    uint64_t nOutPoints;
+    //! Unspent outputs of transactions that are (or were) in the mempool
+    std::vector<COutPoint> vUnconfirmed;
+    //! Confirmed outpoints spent by mempool transactions, candidates for RBF
+    std::vector<COutPoint> vReplaceable;
+
+public:
+    LatencyStats statsAccept;
+    LatencyStats statsReplace;
+    LatencyStats statsTrim;
+    LatencyStats statsSelect;
+    LatencyStats statsBlock;
+    int64_t nAccepted;
+    int64_t nRejected;
+
+    MempoolReplayer(CTxMemPool& _pool) :
+        pool(_pool), nHeight(1), nOutPoints(0),
+        statsAccept("MempoolReplay-accept"), statsReplace("MempoolReplay-replace"),
+        statsTrim("MempoolReplay-trim"), statsSelect("MempoolReplay-select"),
+        statsBlock("MempoolReplay-removeForBlock"), nAccepted(0), nRejected(0)
+    {
+        // Use the same stream on every run so results are comparable
+        seed_insecure_rand(true);
+    }
+
+    CMutableTransaction MakeTx(const std::vector<COutPoint>& vPrevouts, unsigned int nOutputs)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(vPrevouts.size());
+        for (unsigned int i = 0; i < vPrevouts.size(); i++) {
+            tx.vin[i].prevout = vPrevouts[i];
+            tx.vin[i].scriptSig = CScript() << OP_1 << std::vector<unsigned char>(72, insecure_rand() & 0xff);
+        }
+        tx.vout.resize(nOutputs);
+        for (unsigned int i = 0; i < nOutputs; i++) {
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout[i].nValue = COIN;
+        }
+        return tx;
+    }
+
+    COutPoint FreshOutPoint()
+    {
+        COutPoint outpoint(ArithToUint256(arith_uint256(++nOutPoints)), 0);
+        vReplaceable.push_back(outpoint);
+        return outpoint;
+    }
+
+    /** Pop a spendable output of a transaction still in the pool, or a new confirmed one. */
+    COutPoint UnconfirmedOutPoint()
+    {
+        while (!vUnconfirmed.empty()) {
+            size_t i = insecure_rand() % vUnconfirmed.size();
+            COutPoint outpoint = vUnconfirmed[i];
+            vUnconfirmed[i] = vUnconfirmed.back();
+            vUnconfirmed.pop_back();
+            if (pool.exists(outpoint.hash))
+                return outpoint;
+        }
+        return FreshOutPoint();
+    }
+
+    /** Mempool side of AcceptToMemoryPool: limit checks and addUnchecked. */
+    bool Accept(const CMutableTransaction& mtx, CAmount nFee)
+    {
+        CTransaction tx(mtx);
+        int64_t nStart = GetTimeMicros();
+        CTxMemPoolEntry entry(tx, nFee, GetTime(), 0.0, nHeight, pool.HasNoInputsOf(tx), 0, false, 4, LockPoints());
+        CTxMemPool::setEntries setAncestors;
+        std::string errString;
+        bool fAccepted = pool.CalculateMemPoolAncestors(entry, setAncestors,
+            DEFAULT_ANCESTOR_LIMIT, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000,
+            DEFAULT_DESCENDANT_LIMIT, DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString);
+        if (fAccepted)
+            pool.addUnchecked(tx.GetHash(), entry, setAncestors, false);
+        statsAccept.Add(GetTimeMicros() - nStart);
+        if (!fAccepted) {
+            nRejected++;
+            return false;
+        }
+        nAccepted++;
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+            vUnconfirmed.push_back(COutPoint(tx.GetHash(), i));
+        return true;
+    }
+
+    /** Replace whatever spends a confirmed outpoint with a higher paying transaction. */
+    void Replace()
+    {
+        if (vReplaceable.empty())
+            return;
+        size_t i = insecure_rand() % vReplaceable.size();
+        COutPoint outpoint = vReplaceable[i];
+        vReplaceable[i] = vReplaceable.back();
+        vReplaceable.pop_back();
+
+        CMutableTransaction mtx = MakeTx(std::vector<COutPoint>(1, outpoint), 1);
+        CTransaction tx(mtx);
+        int64_t nStart = GetTimeMicros();
+        {
+            LOCK(pool.cs);
+            auto it = pool.mapNextTx.find(outpoint);
+            if (it == pool.mapNextTx.end())
+                return;
+            CTxMemPool::txiter conflictit = pool.mapTx.find(it->second->GetHash());
+            CTxMemPool::setEntries setAllConflicts;
+            pool.CalculateDescendants(conflictit, setAllConflicts);
+            CAmount nConflictingFees = 0;
+            BOOST_FOREACH(CTxMemPool::txiter removeit, setAllConflicts) {
+                nConflictingFees += removeit->GetModifiedFee();
+            }
+            pool.RemoveStaged(setAllConflicts, false);
+            CTxMemPoolEntry entry(tx, nConflictingFees + 10000, GetTime(), 0.0, nHeight, true, 0, false, 4, LockPoints());
+            pool.addUnchecked(tx.GetHash(), entry, false);
+        }
+        statsReplace.Add(GetTimeMicros() - nStart);
+        vReplaceable.push_back(outpoint);
+        vUnconfirmed.push_back(COutPoint(tx.GetHash(), 0));
+    }
+
+    void Trim()
+    {
+        int64_t nStart = GetTimeMicros();
+        pool.TrimToSize(REPLAY_MEMPOOL_LIMIT);
+        statsTrim.Add(GetTimeMicros() - nStart);
+    }
+
+    /** Select packages by ancestor feerate into a block and connect it. */
+    void ConnectBlock()
+    {
+        std::vector<CTransaction> vtx;
+        int64_t nStart = GetTimeMicros();
+        {
+            LOCK(pool.cs);
+            CTxMemPool::setEntries setInBlock;
+            unsigned int nBlockSize = 0;
+            CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = pool.mapTx.get<ancestor_score>().begin();
+            for (; mi != pool.mapTx.get<ancestor_score>().end() && nBlockSize < REPLAY_BLOCK_SIZE; ++mi) {
+                CTxMemPool::txiter it = pool.mapTx.project<0>(mi);
+                if (setInBlock.count(it))
+                    continue;
+                CTxMemPool::setEntries setAncestors;
+                uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+                std::string dummy;
+                pool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+                setAncestors.insert(it);
+                BOOST_FOREACH(CTxMemPool::txiter ancestorit, setAncestors) {
+                    if (setInBlock.insert(ancestorit).second)
+                        nBlockSize += ancestorit->GetTxSize();
+                }
+            }
+            // Ordering by ancestor count yields a valid topological order
+            std::vector<CTxMemPool::txiter> vSorted(setInBlock.begin(), setInBlock.end());
+            std::sort(vSorted.begin(), vSorted.end(), CompareTxIterByAncestorCount());
+            vtx.reserve(vSorted.size());
+            BOOST_FOREACH(CTxMemPool::txiter it, vSorted) {
+                vtx.push_back(it->GetTx());
+            }
+        }
+        statsSelect.Add(GetTimeMicros() - nStart);
+
+        std::list<CTransaction> conflicts;
+        nStart = GetTimeMicros();
+        pool.removeForBlock(vtx, ++nHeight, conflicts, false);
+        statsBlock.Add(GetTimeMicros() - nStart);
+    }
+
+    /** Run one step of the stream. */
+    void Step(int64_t nStep)
+    {
+        uint32_t nKind = insecure_rand() % 100;
+        if (nKind < 45) {
+            // independent transaction
+            Accept(MakeTx(std::vector<COutPoint>(1, FreshOutPoint()), 1 + insecure_rand() % 2), 1000 + insecure_rand() % 50000);
+        } else if (nKind < 70) {
+            // extend an unconfirmed chain, sometimes merging two of them
+            std::vector<COutPoint> vPrevouts(1, UnconfirmedOutPoint());
+            if (nKind < 50)
+                vPrevouts.push_back(UnconfirmedOutPoint());
+            if (vPrevouts.size() == 2 && vPrevouts[0] == vPrevouts[1])
+                vPrevouts.pop_back();
+            Accept(MakeTx(vPrevouts, 1 + insecure_rand() % 2), 1000 + insecure_rand() % 50000);
+        } else if (nKind < 85) {
+            // CPFP: a low fee parent bumped by a high fee child
+            CMutableTransaction parent = MakeTx(std::vector<COutPoint>(1, FreshOutPoint()), 1);
+            if (Accept(parent, 100)) {
+                // the child below is the only spender of the parent's output
+                vUnconfirmed.pop_back();
+                Accept(MakeTx(std::vector<COutPoint>(1, COutPoint(parent.GetHash(), 0)), 1), 100000 + insecure_rand() % 100000);
+            }
+        } else {
+            Replace();
+        }
+
+        if (nStep % 100 == 0)
+            Trim();
+        if (nStep % REPLAY_BLOCK_INTERVAL == 0)
+            ConnectBlock();
+    }
+
+    void Report()
+    {
+        statsAccept.Report();
+        statsReplace.Report();
+        statsTrim.Report();
+        statsSelect.Report();
+        statsBlock.Report();
+        std::cout << "# MempoolReplay: " << nAccepted << " accepted, " << nRejected << " rejected by ancestor limits\n";
+    }
+};
+
+} // anon namespace
+
+static void MempoolReplay(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    MempoolReplayer replayer(pool);
+    int64_t nStep = 0;
+    while (state.KeepRunning()) {
+        replayer.Step(++nStep);
+    }
+    replayer.Report();
+}
+
+BENCHMARK(MempoolReplay);
@@ -13,10 +13,82 @@
 #include "main.h"
 #include "util.h"
 
-#include <unordered_map>
-
 #define MIN_TRANSACTION_BASE_SIZE (::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS))
 
+namespace {
+
+/**
+ * Map from short txids to transaction positions in a block, kept in flat
+ * arrays with open addressing and linear probing, so that the lookup for each
+ * mempool transaction touches one or two cache lines.
+ *
+ * Short txids are chosen by the peer, so slots are derived from them with a
+ * random multiplier, and an insertion that would need a long probe sequence
+ * fails. The table is at most a quarter full, so for honestly computed short
+ * txids that happens far less often than a short ID collision.
+ */
+class ShortTxIDTable
+{
+private:
+    static const uint64_t EMPTY_SLOT = ~(uint64_t)0; // Not a 48-bit short txid
+    static const unsigned int MAX_PROBE = 64;
+
+    std::vector<uint64_t> keys;
+    std::vector<uint16_t> values;
+    uint64_t mul;
+    unsigned int shift;
+    size_t mask;
+
+    size_t Slot(uint64_t shortid) const { return (shortid * mul) >> shift; }
+
+public:
+    ShortTxIDTable(size_t nElements) : mul(GetRand(std::numeric_limits<uint64_t>::max()) | 1)
+    {
+        unsigned int bits = 4;
+        while (((size_t)1 << bits) < nElements * 4)
+            bits++;
+        keys.assign((size_t)1 << bits, (uint64_t)EMPTY_SLOT);
+        values.resize(keys.size());
+        shift = 64 - bits;
+        mask = keys.size() - 1;
+    }
+
+    /** Returns false if shortid is already present or its probe sequence is too long */
+    bool Insert(uint64_t shortid, uint16_t value)
+    {
+        size_t pos = Slot(shortid);
+        for (unsigned int i = 0; i < MAX_PROBE; i++, pos = (pos + 1) & mask) {
+            if (keys[pos] == shortid)
+                return false;
+            if (keys[pos] == EMPTY_SLOT) {
+                keys[pos] = shortid;
+                values[pos] = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Find(uint64_t shortid, uint16_t& value) const
+    {
+        size_t pos = Slot(shortid);
+        for (unsigned int i = 0; i < MAX_PROBE; i++, pos = (pos + 1) & mask) {
+            if (keys[pos] == shortid) {
+                value = values[pos];
+                return true;
+            }
+            if (keys[pos] == EMPTY_SLOT)
+                return false;
+        }
+        return false;
+    }
+};
+
+/** Number of mempool transactions whose short txids are computed at once */
+static const size_t SHORTID_BATCH_SIZE = 64;
+
+} // anon namespace
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -45,9 +117,16 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const* txhashes, size_t count, uint64_t* shortids) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, count, shortids);
+    for (size_t i = 0; i < count; i++)
+        shortids[i] &= 0xffffffffffffL;
+}
+
 
 
-ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock) {
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > >& extra_txn) {
     if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
         return READ_STATUS_INVALID;
     if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_BASE_SIZE / MIN_TRANSACTION_BASE_SIZE)
@@ -79,56 +158,74 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
     // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    const size_t shorttxids_count = cmpctblock.shorttxids.size();
+    ShortTxIDTable shorttxids(shorttxids_count);
     uint16_t index_offset = 0;
-    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
+    for (size_t i = 0; i < shorttxids_count; i++) {
         while (txn_available[i + index_offset])
             index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
+        // TODO: in the shortid-collision case, we should instead request both transactions
+        // which collided. Falling back to full-block-request here is overkill.
+        if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
+            return READ_STATUS_FAILED; // Short ID collision, or too uneven a distribution
     }
-    // TODO: in the shortid-collision case, we should instead request both transactions
-    // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
-        return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
+    const uint256* batch_hashes[SHORTID_BATCH_SIZE];
+    uint64_t batch_shortids[SHORTID_BATCH_SIZE];
+    uint16_t index;
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+    for (size_t start = 0; start < vTxHashes.size() && mempool_count < shorttxids_count; start += SHORTID_BATCH_SIZE) {
+        const size_t batch_count = std::min(SHORTID_BATCH_SIZE, vTxHashes.size() - start);
+        for (size_t j = 0; j < batch_count; j++)
+            batch_hashes[j] = &vTxHashes[start + j].first;
+        cmpctblock.GetShortIDs(batch_hashes, batch_count, batch_shortids);
+
+        for (size_t j = 0; j < batch_count; j++) {
+            if (!shorttxids.Find(batch_shortids[j], index))
+                continue;
+            if (!have_txn[index]) {
+                txn_available[index] = vTxHashes[start + j].second->GetSharedTx();
+                have_txn[index]  = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (txn_available[index]) {
+                    txn_available[index].reset();
                     mempool_count--;
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids_count)
+                break;
+        }
+    }
+
+    for (size_t i = 0; i < extra_txn.size() && mempool_count < shorttxids_count; i++) {
+        if (!shorttxids.Find(cmpctblock.GetShortID(extra_txn[i].first), index))
+            continue;
+        if (!have_txn[index]) {
+            txn_available[index] = extra_txn[i].second;
+            have_txn[index]  = true;
+            mempool_count++;
+            extra_count++;
+        } else {
+            // As above, request a transaction that two candidates match the short id of.
+            // A transaction both in the mempool and among the extra ones is not such a
+            // collision, so compare witness hashes first.
+            if (txn_available[index] &&
+                    txn_available[index]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                txn_available[index].reset();
+                mempool_count--;
+                if (extra_count)
+                    extra_count--;
+            }
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
 
     LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
@@ -170,7 +267,7 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
         return READ_STATUS_CHECKBLOCK_FAILED;
     }
 
-    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool and %lu txn requested\n", header.GetHash().ToString(), prefilled_count, mempool_count, vtx_missing.size());
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool (incl at least %lu from extra pool) and %lu txn requested\n", header.GetHash().ToString(), prefilled_count, mempool_count, extra_count, vtx_missing.size());
     if (vtx_missing.size() < 5) {
         for(const CTransaction& tx : vtx_missing)
             LogPrint("cmpctblock", "Reconstructed block %s required tx %s\n", header.GetHash().ToString(), tx.GetHash().ToString());
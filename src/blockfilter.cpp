@@ -0,0 +1,280 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+
+/**
+ * Map a 64-bit hash uniformly into [0, n) with a multiply and a shift, which
+ * is much faster than a modulo (see "A fast alternative to the modulo
+ * reduction" by Daniel Lemire).
+ */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    // Compute the high 64 bits of the 128-bit product from 32-bit halves
+    uint64_t x_hi = x >> 32;
+    uint64_t x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32;
+    uint64_t n_lo = n & 0xFFFFFFFF;
+
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+template <typename OStream>
+static void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t nP, uint64_t x)
+{
+    // The quotient is written in unary: q 1 bits followed by a 0 bit
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nbits = q <= 64 ? static_cast<int>(q) : 64;
+        bitwriter.Write(~0ULL, nbits);
+        q -= nbits;
+    }
+    bitwriter.Write(0, 1);
+
+    // The remainder is written in P bits
+    bitwriter.Write(x, nP);
+}
+
+template <typename IStream>
+static uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (bitreader.Read(1) == 1)
+        ++q;
+
+    uint64_t r = bitreader.Read(nP);
+    return (q << nP) + r;
+}
+
+GCSFilter::GCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn), nN(0), nF(0)
+{
+    // An empty filter is its element count alone
+    vEncoded.push_back(0);
+}
+
+GCSFilter::GCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+                     const std::vector<unsigned char>& vEncodedIn) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn), vEncoded(vEncodedIn)
+{
+    CDataStream stream(vEncoded, SER_NETWORK, PROTOCOL_VERSION);
+
+    uint64_t nElements = ReadCompactSize(stream);
+    nN = static_cast<uint32_t>(nElements);
+    if (nN != nElements)
+        throw std::ios_base::failure("N must be less than 2^32");
+    nF = static_cast<uint64_t>(nN) * static_cast<uint64_t>(nM);
+
+    // Decode the whole filter to check that the encoding is well formed
+    BitStreamReader<CDataStream> bitreader(stream);
+    for (uint64_t i = 0; i < nN; ++i)
+        GolombRiceDecode(bitreader, nP);
+    if (!stream.empty())
+        throw std::ios_base::failure("encoded filter contains excess data");
+}
+
+GCSFilter::GCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+                     const ElementSet& elements) :
+    nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn)
+{
+    size_t nElements = elements.size();
+    nN = static_cast<uint32_t>(nElements);
+    if (nN != nElements)
+        throw std::invalid_argument("N must be less than 2^32");
+    nF = static_cast<uint64_t>(nN) * static_cast<uint64_t>(nM);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(stream, nN);
+
+    if (!elements.empty()) {
+        BitStreamWriter<CDataStream> bitwriter(stream);
+
+        uint64_t nLastValue = 0;
+        BOOST_FOREACH(uint64_t value, BuildHashedSet(elements)) {
+            uint64_t nDelta = value - nLastValue;
+            GolombRiceEncode(bitwriter, nP, nDelta);
+            nLastValue = value;
+        }
+
+        bitwriter.Flush();
+    }
+
+    vEncoded.assign(stream.begin(), stream.end());
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(nSipHashK0, nSipHashK1)
+        .Write(element.data(), element.size())
+        .Finalize();
+    return MapIntoRange(hash, nF);
+}
+
+std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    BOOST_FOREACH(const Element& element, elements)
+        vHashed.push_back(HashToRange(element));
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool GCSFilter::MatchInternal(const uint64_t* pElementHashes, size_t nSize) const
+{
+    CDataStream stream(vEncoded, SER_NETWORK, PROTOCOL_VERSION);
+
+    // Seek past the element count
+    uint64_t nElements = ReadCompactSize(stream);
+    assert(nElements == nN);
+
+    BitStreamReader<CDataStream> bitreader(stream);
+
+    // Walk the filter and the sorted queries side by side
+    uint64_t nValue = 0;
+    size_t nHashesIndex = 0;
+    for (uint32_t i = 0; i < nN; ++i) {
+        uint64_t nDelta = GolombRiceDecode(bitreader, nP);
+        nValue += nDelta;
+
+        while (true) {
+            if (nHashesIndex == nSize)
+                return false;
+            if (pElementHashes[nHashesIndex] == nValue)
+                return true;
+            if (pElementHashes[nHashesIndex] > nValue)
+                break;
+            nHashesIndex++;
+        }
+    }
+
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    if (vQueries.empty())
+        return false;
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+std::string BlockFilterTypeName(BlockFilterType filterType)
+{
+    switch (filterType) {
+    case BLOCK_FILTER_BASIC: return "basic";
+    default: return "";
+    }
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType)
+{
+    if (name == "basic") {
+        filterType = BLOCK_FILTER_BASIC;
+        return true;
+    }
+    return false;
+}
+
+static GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo)
+{
+    GCSFilter::ElementSet elements;
+
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    BOOST_FOREACH(const CTxUndo& txUndo, blockUndo.vtxundo) {
+        BOOST_FOREACH(const CTxInUndo& txInUndo, txUndo.vprevout) {
+            const CScript& script = txInUndo.txout.scriptPubKey;
+            if (script.empty())
+                continue;
+            elements.insert(GCSFilter::Element(script.begin(), script.end()));
+        }
+    }
+
+    return elements;
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vFilter) :
+    filterType(filterTypeIn), hashBlock(hashBlockIn)
+{
+    uint64_t nSipHashK0, nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    if (!BuildParams(nSipHashK0, nSipHashK1, nP, nM))
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(nSipHashK0, nSipHashK1, nP, nM, vFilter);
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo) :
+    filterType(filterTypeIn), hashBlock(block.GetHash())
+{
+    uint64_t nSipHashK0, nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    if (!BuildParams(nSipHashK0, nSipHashK1, nP, nM))
+        throw std::invalid_argument("unknown filter type");
+    filter = GCSFilter(nSipHashK0, nSipHashK1, nP, nM, BasicFilterElements(block, blockUndo));
+}
+
+bool BlockFilter::BuildParams(uint64_t& nSipHashK0, uint64_t& nSipHashK1, uint8_t& nP, uint32_t& nM) const
+{
+    switch (filterType) {
+    case BLOCK_FILTER_BASIC:
+        // The SipHash key is the first 16 bytes of the block hash
+        nSipHashK0 = ReadLE64(hashBlock.begin());
+        nSipHashK1 = ReadLE64(hashBlock.begin() + 8);
+        nP = BASIC_FILTER_P;
+        nM = BASIC_FILTER_M;
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vData = GetEncodedFilter();
+    return Hash(vData.begin(), vData.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    const uint256 filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set (GCS), a compact probabilistic set as described by
+ * BIP 158. Elements are hashed with SipHash into [0, N * M) and the sorted
+ * hashes are stored as Golomb-Rice coded differences with parameter P. The
+ * false positive rate is about 1 / M.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;      //!< Golomb-Rice coding parameter
+    uint32_t nM;     //!< Inverse false positive rate
+    uint32_t nN;     //!< Number of elements in the filter
+    uint64_t nF;     //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> vEncoded;
+
+    /** Hash a data element to an integer in the range [0, N * M) */
+    uint64_t HashToRange(const Element& element) const;
+
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+
+    /** Whether any of the sorted element hashes are in the set */
+    bool MatchInternal(const uint64_t* pElementHashes, size_t nSize) const;
+
+public:
+    /** Construct an empty filter */
+    GCSFilter(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 0);
+
+    /** Reconstruct a filter from an encoding. Throws std::ios_base::failure if it is malformed. */
+    GCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+              const std::vector<unsigned char>& vEncodedIn);
+
+    /** Build a new filter from a set of elements */
+    GCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn, uint32_t nMIn,
+              const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    /** Whether the element may be in the set. False positives happen at a rate of about 1 / M. */
+    bool Match(const Element& element) const;
+
+    /** Whether any of the elements may be in the set. Faster than calling Match on each. */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/** Golomb-Rice parameter and inverse false positive rate of basic filters (BIP 158) */
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum BlockFilterType : uint8_t
+{
+    BLOCK_FILTER_BASIC = 0,
+    BLOCK_FILTER_INVALID = 255,
+};
+
+/** Get the name of a filter type, or an empty string if it is unknown */
+std::string BlockFilterTypeName(BlockFilterType filterType);
+
+/** Look up a filter type by name */
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType);
+
+/**
+ * A compact filter of a block, as served to light clients (BIP 157). The basic
+ * filter holds every output script created in the block and every output
+ * script spent by it, except data carrier outputs.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    bool BuildParams(uint64_t& nSipHashK0, uint64_t& nSipHashK1, uint8_t& nP, uint32_t& nM) const;
+
+public:
+    BlockFilter() : filterType(BLOCK_FILTER_INVALID) {}
+
+    /** Reconstruct a block filter from an encoding. Throws std::ios_base::failure if it is malformed. */
+    BlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, const std::vector<unsigned char>& vFilter);
+
+    /** Build the filter of a block, using the undo data for the spent outputs */
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Compute the filter hash */
+    uint256 GetHash() const;
+
+    /** Compute the filter header, which commits to the previous block's filter header */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + ::GetSerializeSize(hashBlock, nType, nVersion) + ::GetSerializeSize(filter.GetEncoded(), nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, filterType);
+        ::Serialize(s, hashBlock, nType, nVersion);
+        ::Serialize(s, filter.GetEncoded(), nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        std::vector<unsigned char> vEncoded;
+        filterType = static_cast<BlockFilterType>(ser_readdata8(s));
+        ::Unserialize(s, hashBlock, nType, nVersion);
+        ::Unserialize(s, vEncoded, nType, nVersion);
+
+        uint64_t nSipHashK0, nSipHashK1;
+        uint8_t nP;
+        uint32_t nM;
+        if (!BuildParams(nSipHashK0, nSipHashK1, nP, nM))
+            throw std::ios_base::failure("unknown filter type");
+        filter = GCSFilter(nSipHashK0, nSipHashK1, nP, nM, vEncoded);
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
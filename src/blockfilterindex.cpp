@@ -0,0 +1,134 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilterindex.h"
+
+#include "chain.h"
+#include "dbwrapper.h"
+#include "main.h"
+#include "undo.h"
+#include "util.h"
+
+using namespace std;
+
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_FILTER = 'f';
+static const char DB_FILTER_HEADER = 'h';
+
+CBlockFilterIndex* pblockfilterindex = NULL;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe) :
+    filterType(filterTypeIn)
+{
+    const std::string strFilterName = BlockFilterTypeName(filterType);
+    if (strFilterName.empty())
+        throw std::invalid_argument("unknown filter type");
+
+    strName = strFilterName + " block filter index";
+
+    const boost::filesystem::path path = GetDataDir() / "blocks" / "filter";
+    if (!fMemory)
+        TryCreateDirectory(path);
+    db.reset(new CDBWrapper(path / strFilterName, nCacheSize, fMemory, fWipe));
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+}
+
+bool CBlockFilterIndex::ReadBestBlockLocator(CBlockLocator& locator)
+{
+    return db->Read(DB_BEST_BLOCK, locator);
+}
+
+bool CBlockFilterIndex::WriteBestBlockLocator(const CBlockLocator& locator)
+{
+    return db->Write(DB_BEST_BLOCK, locator);
+}
+
+bool CBlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo blockUndo;
+    uint256 prevHeader;
+
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(blockUndo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+
+        if (pindex->pprev->GetBlockHash() == hashLastBlock) {
+            prevHeader = hashLastHeader;
+        } else {
+            pair<uint256, uint256> prevEntry;
+            if (!db->Read(make_pair(DB_FILTER_HEADER, pindex->pprev->GetBlockHash()), prevEntry))
+                return error("%s: filter header of block %s not found", __func__, pindex->pprev->GetBlockHash().ToString());
+            prevHeader = prevEntry.second;
+        }
+    }
+
+    BlockFilter filter(filterType, block, blockUndo);
+    const uint256 header = filter.ComputeHeader(prevHeader);
+
+    CDBBatch batch(*db);
+    batch.Write(make_pair(DB_FILTER, pindex->GetBlockHash()), filter.GetEncodedFilter());
+    batch.Write(make_pair(DB_FILTER_HEADER, pindex->GetBlockHash()), make_pair(filter.GetHash(), header));
+    if (!db->WriteBatch(batch))
+        return false;
+
+    hashLastBlock = pindex->GetBlockHash();
+    hashLastHeader = header;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    vector<unsigned char> vEncoded;
+    if (!db->Read(make_pair(DB_FILTER, pindex->GetBlockHash()), vEncoded))
+        return false;
+
+    try {
+        filter = BlockFilter(filterType, pindex->GetBlockHash(), vEncoded);
+    } catch (const std::exception& e) {
+        return error("%s: invalid filter of block %s: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    pair<uint256, uint256> entry;
+    if (!db->Read(make_pair(DB_FILTER_HEADER, pindex->GetBlockHash()), entry))
+        return false;
+    header = entry.second;
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, vector<BlockFilter>& vFilters) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vFilters.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (size_t i = vFilters.size(); i-- > 0; pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, vFilters[i]))
+            return false;
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, vector<uint256>& vHashes) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vHashes.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (size_t i = vHashes.size(); i-- > 0; pindex = pindex->pprev) {
+        pair<uint256, uint256> entry;
+        if (!db->Read(make_pair(DB_FILTER_HEADER, pindex->GetBlockHash()), entry))
+            return false;
+        vHashes[i] = entry.first;
+    }
+    return true;
+}
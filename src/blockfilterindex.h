@@ -0,0 +1,64 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include "baseindex.h"
+#include "blockfilter.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+
+class CDBWrapper;
+
+/**
+ * The compact filters of the blocks of the active chain (-blockfilterindex),
+ * built in the background and kept in a database next to the block files.
+ * For each block the filter, its hash and its header are stored by block hash,
+ * so filters of blocks that get disconnected stay valid for those blocks.
+ */
+class CBlockFilterIndex : public CBaseIndex
+{
+private:
+    BlockFilterType filterType;
+    std::string strName;
+    boost::scoped_ptr<CDBWrapper> db;
+
+    /** Header of the last block written, to chain the next one without a read */
+    uint256 hashLastBlock;
+    uint256 hashLastHeader;
+
+protected:
+    const char* GetName() const { return strName.c_str(); }
+    bool ReadBestBlockLocator(CBlockLocator& locator);
+    bool WriteBestBlockLocator(const CBlockLocator& locator);
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+
+    /** Get the filter of a block */
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+
+    /** Get the filter header of a block */
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+
+    /** Get the filters of the blocks from height nStartHeight up to pindexStop */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& vFilters) const;
+
+    /** Get the filter hashes of the blocks from height nStartHeight up to pindexStop */
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHashes) const;
+};
+
+/** The basic block filter index, if -blockfilterindex is set */
+extern CBlockFilterIndex* pblockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
@@ -164,6 +164,7 @@ bool AcceptPendingSyncCheckpoint()
         // Relay the checkpoint
         if (!checkpointMessage.IsNull())
         {
+            LOCK(cs_vNodes);
             for (auto* pnode : vNodes) {
                 checkpointMessage.RelayTo(pnode);
             }
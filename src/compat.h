@@ -84,7 +84,8 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || (defined(USE_EPOLL) && defined(USE_POLL))
+    // Sockets are never added to an fd_set, so FD_SETSIZE does not apply
     return true;
 #else
     return (s < FD_SETSIZE);
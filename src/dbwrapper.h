@@ -271,9 +271,29 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    /**
+     * Iterate over the database, or over the state it was in when snapshot
+     * was taken if one is given.
+     */
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot = NULL)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
+    /**
+     * Take a snapshot of the database, for a series of reads that must see
+     * the same state. Release it with ReleaseSnapshot.
+     */
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        pdb->ReleaseSnapshot(snapshot);
     }
 
     /**
@@ -208,3 +208,63 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+/* Number of hashes SipHashUint256Batch computes in lockstep */
+static const size_t SIPHASH_BATCH_LANES = 4;
+
+#define SIPROUND_LANES do { \
+    for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++) { \
+        v0[j] += v1[j]; v1[j] = ROTL(v1[j], 13); v1[j] ^= v0[j]; \
+        v0[j] = ROTL(v0[j], 32); \
+        v2[j] += v3[j]; v3[j] = ROTL(v3[j], 16); v3[j] ^= v2[j]; \
+        v0[j] += v3[j]; v3[j] = ROTL(v3[j], 21); v3[j] ^= v0[j]; \
+        v2[j] += v1[j]; v1[j] = ROTL(v1[j], 17); v1[j] ^= v2[j]; \
+        v2[j] = ROTL(v2[j], 32); \
+    } \
+} while (0)
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out)
+{
+    const uint64_t init0 = 0x736f6d6570736575ULL ^ k0;
+    const uint64_t init1 = 0x646f72616e646f6dULL ^ k1;
+    const uint64_t init2 = 0x6c7967656e657261ULL ^ k0;
+    const uint64_t init3 = 0x7465646279746573ULL ^ k1;
+
+    size_t i = 0;
+    for (; i + SIPHASH_BATCH_LANES <= count; i += SIPHASH_BATCH_LANES) {
+        uint64_t v0[SIPHASH_BATCH_LANES], v1[SIPHASH_BATCH_LANES], v2[SIPHASH_BATCH_LANES], v3[SIPHASH_BATCH_LANES];
+        uint64_t d[SIPHASH_BATCH_LANES];
+        for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++) {
+            v0[j] = init0;
+            v1[j] = init1;
+            v2[j] = init2;
+            v3[j] = init3;
+        }
+        for (int w = 0; w < 4; w++) {
+            for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++) {
+                d[j] = vals[i + j]->GetUint64(w);
+                v3[j] ^= d[j];
+            }
+            SIPROUND_LANES;
+            SIPROUND_LANES;
+            for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++)
+                v0[j] ^= d[j];
+        }
+        for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++)
+            v3[j] ^= ((uint64_t)4) << 59;
+        SIPROUND_LANES;
+        SIPROUND_LANES;
+        for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++) {
+            v0[j] ^= ((uint64_t)4) << 59;
+            v2[j] ^= 0xFF;
+        }
+        SIPROUND_LANES;
+        SIPROUND_LANES;
+        SIPROUND_LANES;
+        SIPROUND_LANES;
+        for (size_t j = 0; j < SIPHASH_BATCH_LANES; j++)
+            out[i + j] = v0[j] ^ v1[j] ^ v2[j] ^ v3[j];
+    }
+    for (; i < count; i++)
+        out[i] = SipHashUint256(k0, k1, *vals[i]);
+}
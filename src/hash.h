@@ -205,4 +205,12 @@ public:
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 
+/** Compute out[i] = SipHashUint256(k0, k1, *vals[i]) for count values.
+ *
+ *  Several independent hashes are computed in lockstep, which lets the
+ *  compiler keep them in vector registers and overlap their rounds. Use this
+ *  when hashing many values under the same key.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, size_t count, uint64_t* out);
+
 #endif // BITCOIN_HASH_H
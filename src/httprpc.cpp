@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -19,6 +20,7 @@
 #include "utilstrencodings.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp> //BOOST_FOREACH
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
@@ -79,6 +81,8 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
 
     std::string strReply = JSONRPCReply(NullUniValue, objError, id);
 
+    // Drop any partly streamed result
+    req->ClearBody();
     req->WriteHeader("Content-Type", "application/json");
     req->WriteReply(nStatus, strReply);
 }
@@ -179,24 +183,31 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
+        // The reply is serialized straight into the HTTP reply body
+        CJSONStreamWriter writer(boost::bind(&HTTPRequest::WriteBody, req, _1, _2));
+
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            writer.BeginObject();
+            writer.Key("result");
+            tableRPC.execute(jreq.strMethod, jreq.params, writer);
+            writer.KeyValue("error", NullUniValue);
+            writer.KeyValue("id", jreq.id);
+            writer.EndObject();
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            JSONRPCExecBatch(valRequest.get_array(), writer);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
+        writer.Raw("\n");
+        writer.Flush();
+
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+        req->WriteReply(HTTP_OK);
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -179,6 +179,8 @@ struct evhttp* eventHTTP = 0;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Seconds before an idle connection, or a chunked reply the client does not take, is given up on
+static int nServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -415,7 +417,8 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    nServerTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    evhttp_set_timeout(http, nServerTimeout);
     evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, NULL);
@@ -534,13 +537,115 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+
+/** State of a chunked reply, shared between the worker thread producing it
+ * and the main http thread sending it. Deleted by the main http thread when
+ * the reply is finished.
+ */
+struct HTTPChunkedReply
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! Bytes passed to WriteChunk
+    size_t nWritten;
+    //! Bytes handed to libevent, and how many of those were written to the connection
+    size_t nQueued;
+    size_t nSent;
+    //! Whether the connection was closed before the reply was finished
+    bool fClosed;
+
+    HTTPChunkedReply() : nWritten(0), nQueued(0), nSent(0), fClosed(false) {}
+};
+
+static void http_chunked_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPChunkedReply* chunked = (HTTPChunkedReply*)arg;
+    boost::lock_guard<boost::mutex> lock(chunked->cs);
+    chunked->fClosed = true;
+    chunked->cond.notify_all();
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+static void http_chunk_sent_cb(struct evhttp_connection*, void* arg)
+{
+    // Called when everything handed to the connection has been written out
+    HTTPChunkedReply* chunked = (HTTPChunkedReply*)arg;
+    boost::lock_guard<boost::mutex> lock(chunked->cs);
+    chunked->nSent = chunked->nQueued;
+    chunked->cond.notify_all();
+}
+#endif
+
+static void http_start_chunked(struct evhttp_request* req, int nStatus, HTTPChunkedReply* chunked)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        evhttp_connection_set_closecb(evcon, http_chunked_close_cb, chunked);
+    } else {
+        http_chunked_close_cb(NULL, chunked);
+    }
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+static void http_send_chunk(struct evhttp_request* req, struct evbuffer* evb, HTTPChunkedReply* chunked)
+{
+    size_t nSize = evbuffer_get_length(evb);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    {
+        boost::lock_guard<boost::mutex> lock(chunked->cs);
+        chunked->nQueued += nSize;
+    }
+    evhttp_send_reply_chunk_with_cb(req, evb, http_chunk_sent_cb, chunked);
+#else
+    // No notification of completed writes, so only what has not been handed
+    // to libevent yet counts as waiting
+    evhttp_send_reply_chunk(req, evb);
+    {
+        boost::lock_guard<boost::mutex> lock(chunked->cs);
+        chunked->nQueued += nSize;
+        chunked->nSent = chunked->nQueued;
+        chunked->cond.notify_all();
+    }
+#endif
+    evbuffer_free(evb);
+}
+
+static void http_end_chunked(struct evhttp_request* req, HTTPChunkedReply* chunked)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+    // Replaces the write callback, so http_chunk_sent_cb is not called anymore
+    evhttp_send_reply_end(req);
+    delete chunked;
+}
+
+static void http_abort_chunked(struct evhttp_request* req, HTTPChunkedReply* chunked)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+        // Drop the connection without the last chunk, so the client sees the
+        // reply is incomplete. This frees the request as well.
+        evhttp_connection_free(evcon);
+    } else {
+        // The client is gone already, only the request is left to free
+        evhttp_send_reply_end(req);
+    }
+    delete chunked;
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       chunked(0)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && chunked) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        AbortChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -586,6 +691,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+void HTTPRequest::WriteBody(const char* data, size_t size)
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, data, size);
+}
+
+void HTTPRequest::ClearBody()
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_drain(evb, evbuffer_get_length(evb));
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -593,7 +714,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && req && !chunked);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -605,6 +726,63 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && req && !chunked);
+    chunked = new HTTPChunkedReply();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_start_chunked, req, nStatus, chunked));
+    ev->trigger(0);
+}
+
+bool HTTPRequest::WriteChunk(const char* data, size_t size)
+{
+    assert(!replySent && req && chunked);
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, data, size);
+
+    boost::unique_lock<boost::mutex> lock(chunked->cs);
+    chunked->nWritten += size;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_send_chunk, req, evb, chunked));
+    ev->trigger(0);
+
+    // Wait for a slow client to catch up, but not for longer than the
+    // -rpcservertimeout: a client reading a trickle at a time would otherwise
+    // keep this worker thread for as long as it likes.
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(nServerTimeout);
+    while (!chunked->fClosed && chunked->nWritten - chunked->nSent > HTTP_CHUNKED_BACKLOG) {
+        if (!chunked->cond.timed_wait(lock, deadline)) {
+            LogPrint("http", "Chunked reply not taken by the client within %d seconds\n", nServerTimeout);
+            return false;
+        }
+    }
+    return !chunked->fClosed;
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && req && chunked);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_end_chunked, req, chunked));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+    chunked = 0;
+}
+
+void HTTPRequest::AbortChunkedReply()
+{
+    assert(!replySent && req && chunked);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_abort_chunked, req, chunked));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+    chunked = 0;
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
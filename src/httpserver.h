@@ -14,11 +14,14 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a chunked reply that may be waiting to be sent before WriteChunk blocks */
+static const size_t HTTP_CHUNKED_BACKLOG = 4 * 1024 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -57,6 +60,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    HTTPChunkedReply* chunked;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -103,15 +107,61 @@ public:
      */
     void WriteHeader(const std::string& hdr, const std::string& value);
 
+    /**
+     * Append data to the reply body, to be sent by WriteReply. This lets a
+     * large reply be written in parts instead of as one string.
+     */
+    void WriteBody(const char* data, size_t size);
+
+    /**
+     * Drop what was appended to the reply body so far.
+     */
+    void ClearBody();
+
     /**
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
-     * strReply is the body of the reply. Keep it empty to send a standard message.
+     * strReply is the body of the reply, appended to anything written with WriteBody.
+     * Keep both empty to send a standard message.
      *
      * @note Can be called only once. As this will give the request back to the
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in parts as it is produced, using
+     * chunked transfer encoding. Write the body with WriteChunk and finish
+     * with EndChunkedReply (or AbortChunkedReply on error) instead of calling
+     * WriteReply.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send part of a chunked reply. Blocks while more than
+     * HTTP_CHUNKED_BACKLOG bytes are waiting to be sent, so the reply is
+     * produced no faster than the client reads it.
+     * Returns false if the connection was closed, or if the backlog was not
+     * sent within -rpcservertimeout seconds.
+     */
+    bool WriteChunk(const char* data, size_t size);
+
+    /**
+     * Finish a chunked reply.
+     *
+     * @note As for WriteReply, do not call any other HTTPRequest methods
+     * after calling this.
+     */
+    void EndChunkedReply();
+
+    /**
+     * Give up on a chunked reply: close the connection without finishing the
+     * body, so the client can tell it is incomplete.
+     *
+     * @note As for WriteReply, do not call any other HTTPRequest methods
+     * after calling this.
+     */
+    void AbortChunkedReply();
 };
 
 /** Event handler closure.
@@ -5,10 +5,12 @@
 
 #include "main.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "base58.h"
 #include "blockencodings.h"
+#include "blockfilterindex.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -16,6 +18,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "init.h"
 #include "merkleblock.h"
@@ -72,16 +76,20 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fAddressIndex = false;
+bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fFastCmpctRelay = DEFAULT_FAST_CMPCT_RELAY;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
+size_t nBlockReconstructionExtraTxn = DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN;
 
 // Bittrex refund address
 CBitcoinAddress bittrexAddress("CNWvERBhD756zKxMsLmikkj6Ee71wr4mNs");
@@ -227,6 +235,12 @@ namespace {
     /** Stack of nodes which we have set to announce using compact blocks */
     list<NodeId> lNodesAnnouncingHeaderAndIDs;
 
+    /** Transactions we have seen but not kept in the mempool (orphans, replaced, trimmed and
+     *  rejected ones), in <witness hash, reference> form, so they can still fill in compact
+     *  blocks. Used as a ring buffer once full. Protected by cs_main. */
+    std::vector<std::pair<uint256, std::shared_ptr<const CTransaction> > > vExtraTxnForCompact;
+    size_t vExtraTxnForCompactIt = 0;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
@@ -244,6 +258,26 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Number of consecutive active chain headers in each span of the getheaders cache. */
+    const int HEADERS_CACHE_SPAN = 2000;
+    /** Maximum number of spans kept in the getheaders cache. */
+    const size_t MAX_HEADERS_CACHE_SPANS = 64;
+
+    /** Headers of one aligned range of heights in the active chain, serialized the way
+     *  they are sent in a headers message. Never modified once shared. */
+    struct CSerializedHeaders {
+        uint256 hashLast;       //!< Hash of the last block in the span, to detect reorganizations
+        size_t nEntrySize;      //!< Serialized size of each header
+        std::vector<char> vData;
+    };
+    struct CHeadersCacheEntry {
+        std::shared_ptr<const CSerializedHeaders> headers;
+        uint64_t nLastUsed;
+    };
+    /** Getheaders cache, by span number (height / HEADERS_CACHE_SPAN), protected by cs_main. */
+    std::map<int, CHeadersCacheEntry> mapHeadersCache;
+    uint64_t nHeadersCacheUses = 0;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -295,6 +329,8 @@ struct CNodeState {
     list<QueuedBlock> vBlocksInFlight;
     //! When the first entry in vBlocksInFlight started downloading. Don't care when vBlocksInFlight is empty.
     int64_t nDownloadingSince;
+    //! Moving average of the time (in microseconds) this peer takes to deliver each requested block, or 0 if unknown.
+    int64_t nBlockDownloadTime;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
@@ -331,6 +367,7 @@ struct CNodeState {
         fSyncStarted = false;
         nStallingSince = 0;
         nDownloadingSince = 0;
+        nBlockDownloadTime = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
@@ -409,7 +446,8 @@ void FinalizeNode(NodeId nodeid) {
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-bool MarkBlockAsReceived(const uint256& hash) {
+// nodeFrom is the peer that delivered the block, if any.
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
@@ -419,8 +457,14 @@ bool MarkBlockAsReceived(const uint256& hash) {
             nPeersWithValidatedDownloads--;
         }
         if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
+            int64_t nNow = GetTimeMicros();
+            if (itInFlight->second.first == nodeFrom && nNow > state->nDownloadingSince) {
+                // The peer delivered the block it was working on; fold the time it took into its download speed
+                int64_t nTime = nNow - state->nDownloadingSince;
+                state->nBlockDownloadTime = state->nBlockDownloadTime ? (3 * state->nBlockDownloadTime + nTime) / 4 : nTime;
+            }
             // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            state->nDownloadingSince = std::max(state->nDownloadingSince, nNow);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -544,6 +588,28 @@ bool PeerHasHeader(CNodeState *state, CBlockIndex *pindex)
     return false;
 }
 
+/** Number of blocks to have in flight from a peer at once. Once its download speed
+ *  is known, this covers BLOCK_DOWNLOAD_QUEUE_TIME worth of its downloading. */
+int GetBlocksInTransitLimit(const CNodeState* state) {
+    if (state->nBlockDownloadTime == 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nLimit = BLOCK_DOWNLOAD_QUEUE_TIME / state->nBlockDownloadTime;
+    return std::max<int64_t>(MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, nLimit));
+}
+
+/** Whether nodeid downloads blocks at least twice as fast as nodeOther. A block
+ *  nodeOther is still working on counts against it for as long as it has taken. */
+bool IsMuchFasterDownloader(NodeId nodeid, NodeId nodeOther) {
+    CNodeState* state = State(nodeid);
+    CNodeState* stateOther = State(nodeOther);
+    if (state->nBlockDownloadTime == 0)
+        return false;
+    int64_t nOtherTime = stateOther->nBlockDownloadTime;
+    if (stateOther->nBlocksInFlight > 0)
+        nOtherTime = std::max(nOtherTime, GetTimeMicros() - stateOther->nDownloadingSince);
+    return 2 * state->nBlockDownloadTime < nOtherTime;
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
@@ -582,6 +648,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -614,6 +681,16 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
                     // We reached the end of the window.
+                    if (waitingfor != -1 && waitingfor != nodeid && vBlocks.size() < count &&
+                        IsMuchFasterDownloader(nodeid, waitingfor) &&
+                        !mapBlocksInFlight[pindexWaitingFor->GetBlockHash()].second->partialBlock) {
+                        // The window is held up by a block from a much slower peer. Fetch it
+                        // from this one instead of waiting for that peer to stall.
+                        LogPrint("net", "Re-requesting block %s (%d) from peer=%d instead of slower peer=%d\n",
+                            pindexWaitingFor->GetBlockHash().ToString(), pindexWaitingFor->nHeight, nodeid, waitingfor);
+                        vBlocks.push_back(pindexWaitingFor);
+                        return;
+                    }
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
@@ -627,6 +704,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -707,6 +785,18 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
+void AddToCompactExtraTransactions(const std::shared_ptr<const CTransaction>& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (nBlockReconstructionExtraTxn == 0)
+        return;
+    if (vExtraTxnForCompact.size() < nBlockReconstructionExtraTxn) {
+        vExtraTxnForCompact.push_back(std::make_pair(tx->GetWitnessHash(), tx));
+    } else {
+        vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
+        vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % nBlockReconstructionExtraTxn;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -738,6 +828,8 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
 
+    AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
+
     LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
              mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
     return true;
@@ -1136,9 +1228,12 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
     std::vector<uint256> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    std::vector<std::shared_ptr<const CTransaction> > vTxnRemoved;
+    pool.TrimToSize(limit, &vNoSpendsRemaining, &vTxnRemoved);
     BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
+    BOOST_FOREACH(const std::shared_ptr<const CTransaction>& tx, vTxnRemoved)
+        AddToCompactExtraTransactions(tx);
 }
 
 /** Convert CValidationState to a human-readable message for logging */
@@ -1150,6 +1245,42 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("bitcoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/**
+ * CheckInputs for mempool acceptance. The scripts of transactions with at
+ * least MIN_PARALLEL_MEMPOOL_SCRIPT_INPUTS inputs are verified on the script
+ * check threads; if that fails, the inputs are checked again serially so that
+ * state carries the exact reject reason and DoS score.
+ * Block validation uses the same queue, which is safe because both hold
+ * cs_main while the queue is in use.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, unsigned int flags, bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || tx.vin.size() < MIN_PARALLEL_MEMPOOL_SCRIPT_INPUTS)
+        return CheckInputs(tx, state, view, true, flags, true, cacheFullScriptStore, txdata);
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, cacheFullScriptStore, txdata, &vChecks))
+        return false;
+    if (vChecks.empty())
+        return true; // script execution cache hit
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait()) {
+        if (cacheFullScriptStore)
+            AddScriptExecutionCacheEntry(tx, flags);
+        return true;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, cacheFullScriptStore, txdata);
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                               bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
                               std::vector<uint256>& vHashTxnToUncache)
@@ -1534,30 +1665,36 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
-            if (tx.wit.IsNull() && CheckInputs(tx, state, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, state, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            if (tx.wit.IsNull() && CheckInputs(tx, state, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                !CheckInputs(tx, state, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
             return false;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
+        // Check again against the consensus-critical script verification
+        // flags the next block will be validated with, in case of bugs in the
+        // standard flags that cause transactions to pass as valid when they're
+        // actually invalid. For instance the STRICTENC flag was incorrectly
+        // allowing certain CHECKSIG NOT scripts to pass, even though they were
+        // invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        //
+        // The signatures are all in the signature cache by now, and a success
+        // is remembered in the script execution cache so that ConnectBlock
+        // can skip this transaction's scripts entirely.
+        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(ComputeBlockVersion(chainActive.Tip(), chainparams.GetConsensus()), chainActive.Tip(), chainparams.GetConsensus());
+        if (!CheckInputsForMempool(tx, state, view, currentBlockScriptVerifyFlags, true, txdata))
         {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against block but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
 
@@ -1569,8 +1706,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                     hash.ToString(),
                     FormatMoney(nModifiedFees - nConflictingFees),
                     (int)nSize - (int)nConflictingSize);
+            AddToCompactExtraTransactions(it->GetSharedTx());
         }
-        pool.RemoveStaged(allConflicting, false);
+        pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
@@ -1600,13 +1738,52 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
-/** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
+bool GetSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        const COutPoint outpoint(key.txid, key.outputIndex);
+        indirectmap<COutPoint, const CTransaction*>::const_iterator it = mempool.mapNextTx.find(outpoint);
+        if (it != mempool.mapNextTx.end()) {
+            const CTransaction& tx = *it->second;
+            unsigned int nInput = 0;
+            while (nInput < tx.vin.size() && tx.vin[nInput].prevout != outpoint)
+                nInput++;
+            assert(nInput < tx.vin.size());
+
+            // The spent output is either confirmed or in the memory pool itself
+            CTxOut txout;
+            std::shared_ptr<const CTransaction> ptxPrev = mempool.get(key.txid);
+            if (ptxPrev) {
+                if (key.outputIndex < ptxPrev->vout.size())
+                    txout = ptxPrev->vout[key.outputIndex];
+            } else {
+                const CCoins* coins = pcoinsTip->AccessCoins(key.txid);
+                if (coins && coins->IsAvailable(key.outputIndex))
+                    txout = coins->vout[key.outputIndex];
+            }
+            int nAddressType = ADDRESS_INDEX_NONE;
+            uint160 hashBytes;
+            GetAddressIndexHash(txout.scriptPubKey, nAddressType, hashBytes);
+            value = CSpentIndexValue(tx.GetHash(), nInput, -1, txout.nValue, nAddressType, hashBytes);
+            return true;
+        }
+    }
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+/**
+ * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
+ * cs_main is only taken to find the block of the slow lookup; no lock is held while reading from disk.
+ */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
     CBlockIndex *pindexSlow = NULL;
 
-    LOCK(cs_main);
-
     std::shared_ptr<const CTransaction> ptx = mempool.get(hash);
     if (ptx)
     {
@@ -1636,6 +1813,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     }
 
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+        LOCK(cs_main);
         int nHeight = -1;
         {
             const CCoinsViewCache& view = *pcoinsTip;
@@ -1728,6 +1906,57 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/** Read the data at pos of an open block or undo file, as announced by the index header in front of it */
+static bool ReadRawFromDisk(CAutoFile& filein, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, std::vector<unsigned char>& vch)
+{
+    if (filein.IsNull())
+        return error("%s: failed to open file for %s", __func__, pos.ToString());
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: no index header in front of %s", __func__, pos.ToString());
+
+    // Go back to the index header written by WriteBlockToDisk or UndoWriteToDisk
+    if (fseek(filein.Get(), pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int), SEEK_SET))
+        return error("%s: fseek failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars fileMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(fileMessageStart) >> nSize;
+        if (memcmp(fileMessageStart, messageStart, MESSAGE_START_SIZE))
+            return error("%s: index header mismatch at %s", __func__, pos.ToString());
+        if (nSize == 0 || nSize > MAX_SIZE)
+            return error("%s: invalid size %u at %s", __func__, nSize, pos.ToString());
+        vch.resize(nSize);
+        filein.read((char*)&vch[0], nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (!ReadRawFromDisk(filein, pos, messageStart, vchBlock))
+        return false;
+
+    // Only the header is parsed, to make sure this is the block asked for
+    CBlockHeader header;
+    try {
+        const char* pch = (const char*)&vchBlock[0];
+        CDataStream ssHeader(pch, pch + std::min(vchBlock.size(), (size_t)80), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pos.ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int64_t nSubsidy = 420 * COIN;
@@ -2028,7 +2257,61 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+namespace {
+
+/**
+ * Script execution cache: transactions whose scripts all passed with a given
+ * set of flags, so that blocks built from our own mempool don't need to run
+ * them again. Entries are SHA256(nonce || wtxid || flags). Protected by
+ * cs_main.
+ */
+CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+uint256 scriptExecutionCacheNonce(GetRandHash());
+size_t nScriptExecutionCacheMaxEntries = 0;
+std::atomic<uint64_t> nScriptExecutionCacheHits(0);
+std::atomic<uint64_t> nScriptExecutionCacheMisses(0);
+std::atomic<uint64_t> nScriptExecutionCacheInserts(0);
+
+uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 entry;
+    uint256 hashWitness = tx.GetWitnessHash();
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(hashWitness.begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
+    return entry;
+}
+
+} // anon namespace
+
+void InitScriptExecutionCache()
+{
+    // Sized like the signature cache, see InitSignatureCache().
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    LOCK(cs_main);
+    nScriptExecutionCacheMaxEntries = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nScriptExecutionCacheMaxEntries*sizeof(uint256)) >>20, nMaxCacheSize>>20, nScriptExecutionCacheMaxEntries);
+}
+
+ValidationCacheStats GetScriptExecutionCacheStats()
+{
+    ValidationCacheStats stats;
+    LOCK(cs_main);
+    stats.nMaxEntries = nScriptExecutionCacheMaxEntries;
+    stats.nBytes = scriptExecutionCache.MemoryUsage();
+    stats.nHits = nScriptExecutionCacheHits.load(std::memory_order_relaxed);
+    stats.nMisses = nScriptExecutionCacheMisses.load(std::memory_order_relaxed);
+    stats.nInserts = nScriptExecutionCacheInserts.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AddScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    nScriptExecutionCacheInserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -2049,13 +2332,27 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // the checkpoint is for a chain that's invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
+            // First check if script executions have been cached with the same
+            // flags. Note that this assumes that the inputs provided are
+            // correct (ie that the transaction hash which is in tx's prevouts
+            // properly commits to the scriptPubKey in the inputs view of that
+            // transaction). Lookups that don't store (block connection) erase
+            // the entry, as it will not be needed again.
+            AssertLockHeld(cs_main);
+            uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
+            bool fCached = scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore);
+            if (!cacheFullScriptStore)
+                (fCached ? nScriptExecutionCacheHits : nScriptExecutionCacheMisses).fetch_add(1, std::memory_order_relaxed);
+            if (fCached)
+                return true;
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(*coins, tx, i, flags, cacheSigStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2068,7 +2365,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -2082,6 +2379,13 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
+                nScriptExecutionCacheInserts.fetch_add(1, std::memory_order_relaxed);
+            }
         }
     }
 
@@ -2117,6 +2421,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -2144,6 +2450,33 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+bool ReadRawUndoFromDisk(std::vector<unsigned char>& vchUndo, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const CDiskBlockPos pos = pindex->GetUndoPos();
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (!ReadRawFromDisk(filein, pos, messageStart, vchUndo))
+        return false;
+
+    uint256 hashChecksum;
+    try {
+        filein >> hashChecksum;
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // Verify checksum, which is over the serialized undo data as read
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << pindex->pprev->GetBlockHash();
+    hasher.write((const char*)&vchUndo[0], vchUndo.size());
+    if (hashChecksum != hasher.GetHash())
+        return error("%s: Checksum mismatch", __func__);
+
+    return true;
+}
+
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -2197,7 +2530,7 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
     return fClean;
 }
 
-bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -2216,11 +2549,26 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (fAddressIndex && !fJustCheck) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                int nAddressType;
+                uint160 hashBytes;
+                if (!GetAddressIndexHash(tx.vout[k].scriptPubKey, nAddressType, hashBytes))
+                    continue;
+                vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
@@ -2250,10 +2598,31 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
+
+                if (fSpentIndex && !fJustCheck)
+                    vSpentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
+
+                int nAddressType;
+                uint160 hashBytes;
+                if (fAddressIndex && !fJustCheck && GetAddressIndexHash(undo.txout.scriptPubKey, nAddressType, hashBytes)) {
+                    // The undo data only has the height of the last output spent from
+                    // a transaction, but the restored coins always have it
+                    const CCoins *coins = view.AccessCoins(out.hash);
+                    int nPrevHeight = coins ? coins->nHeight : undo.nHeight;
+                    vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, j, true), undo.txout.nValue * -1));
+                    vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, out.hash, out.n),
+                                                                  CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, nPrevHeight)));
+                }
             }
         }
     }
 
+    if (fAddressIndex && !fJustCheck && !pblocktree->EraseAddressIndex(vAddressIndex, vAddressUnspentIndex))
+        return AbortNode(state, "Failed to delete address index");
+
+    if (fSpentIndex && !fJustCheck && !pblocktree->UpdateSpentIndex(vSpentIndex))
+        return AbortNode(state, "Failed to delete spent index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2290,13 +2659,6 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
-void ThreadScriptCheck() {
-    RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
-}
-
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2315,6 +2677,37 @@ int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Para
     return nVersion;
 }
 
+unsigned int GetBlockScriptFlags(int32_t nVersion, const CBlockIndex* pindexPrev, const Consensus::Params& consensusparams)
+{
+    AssertLockHeld(cs_main);
+    unsigned int flags = SCRIPT_VERIFY_P2SH;
+
+    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
+    // when 75% of the network has upgraded:
+    if (nVersion >= 3 && IsSuperMajority(3, pindexPrev, consensusparams.nMajorityEnforceBlockUpgrade, consensusparams)) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
+    // blocks, when 75% of the network has upgraded:
+    if (nVersion >= 4 && IsSuperMajority(4, pindexPrev, consensusparams.nMajorityEnforceBlockUpgrade, consensusparams)) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindexPrev, consensusparams, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    // Start enforcing WITNESS rules using versionbits logic.
+    if (IsWitnessEnabled(pindexPrev, consensusparams)) {
+        flags |= SCRIPT_VERIFY_WITNESS;
+        flags |= SCRIPT_VERIFY_NULLDUMMY;
+    }
+
+    return flags;
+}
+
 /**
  * Threshold condition checker that triggers when unknown versionbits are seen on the network.
  */
@@ -2405,33 +2798,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    unsigned int flags = SCRIPT_VERIFY_P2SH;
-
-    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
-    // when 75% of the network has upgraded:
-    if (block.nVersion >= 3 && IsSuperMajority(3, pindex->pprev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus())) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
-    // blocks, when 75% of the network has upgraded:
-    if (block.nVersion >= 4 && IsSuperMajority(4, pindex->pprev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus())) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
+    unsigned int flags = GetBlockScriptFlags(block.nVersion, pindex->pprev, chainparams.GetConsensus());
 
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) along with BIP112 (CHECKSEQUENCEVERIFY).
     int nLockTimeFlags = 0;
-    if (VersionBitsState(pindex->pprev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    if (flags & SCRIPT_VERIFY_CHECKSEQUENCEVERIFY) {
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
-    // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus())) {
-        flags |= SCRIPT_VERIFY_WITNESS;
-        flags |= SCRIPT_VERIFY_NULLDUMMY;
-    }
-
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
@@ -2444,9 +2818,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -2503,20 +2877,51 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
 
+        if (fAddressIndex && !fJustCheck) {
+            const uint256 hash = tx.GetHash();
+            int nAddressType;
+            uint160 hashBytes;
+            if (!tx.IsCoinBase()) {
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
+                    if (!GetAddressIndexHash(prevout.scriptPubKey, nAddressType, hashBytes))
+                        continue;
+                    vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+                    vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, tx.vin[j].prevout.hash, tx.vin[j].prevout.n), CAddressUnspentValue()));
+                }
+            }
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                if (!GetAddressIndexHash(tx.vout[k].scriptPubKey, nAddressType, hashBytes))
+                    continue;
+                vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nAddressType, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                vAddressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(nAddressType, hashBytes, hash, k),
+                                                              CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, pindex->nHeight)));
+            }
+        }
+
+        if (fSpentIndex && !fJustCheck && !tx.IsCoinBase()) {
+            const uint256 hash = tx.GetHash();
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
+                int nAddressType = ADDRESS_INDEX_NONE;
+                uint160 hashBytes;
+                GetAddressIndexHash(prevout.scriptPubKey, nAddressType, hashBytes);
+                vSpentIndex.push_back(std::make_pair(CSpentIndexKey(tx.vin[j].prevout.hash, tx.vin[j].prevout.n),
+                                                     CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, nAddressType, hashBytes)));
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
-
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
@@ -2557,9 +2962,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    if (fAddressIndex)
+        if (!pblocktree->WriteAddressIndex(vAddressIndex, vAddressUnspentIndex))
+            return AbortNode(state, "Failed to write address index");
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(vSpentIndex))
+            return AbortNode(state, "Failed to write spent index");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2799,7 +3208,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
             list<CTransaction> removed;
             CValidationState stateDummy;
             if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, true)) {
-                mempool.removeRecursive(tx, removed);
+                mempool.removeRecursive(tx, removed, MemPoolRemovalReason::REORG);
             } else if (mempool.exists(tx.GetHash())) {
                 vHashUpdate.push_back(tx.GetHash());
             }
@@ -2814,6 +3223,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    GetMainSignals().BlockDisconnected(block, pindexDelete);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
@@ -3697,6 +4107,48 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+/**
+ * Send a new block that extends our tip and has passed its proof of work,
+ * merkle root and other checks short of connecting it, to the peers that
+ * asked us to announce blocks as compact blocks, without waiting for
+ * ConnectBlock. BIP 152 allows this only towards peers that do not ban for
+ * an invalid compact block; the others are sent it by SendMessages once it
+ * is connected. Only the first such block at each height is relayed early.
+ */
+static void RelayCompactBlockBeforeConnect(const CBlock& block, CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+
+    static int nHighestFastAnnounce = 0;
+    if (pindex->nHeight <= nHighestFastAnnounce)
+        return;
+    nHighestFastAnnounce = pindex->nHeight;
+
+    bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, consensusParams);
+    std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock[2];
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+            continue;
+        ProcessBlockAvailability(pnode->GetId());
+        CNodeState &state = *State(pnode->GetId());
+        // Only announce to peers that have, or were announced, the parent
+        // but not this block already
+        if (!state.fPreferHeaderAndIDs || (fWitnessEnabled && !state.fWantsCmpctWitness) ||
+                PeerHasHeader(&state, pindex) || !PeerHasHeader(&state, pindex->pprev))
+            continue;
+
+        std::unique_ptr<CBlockHeaderAndShortTxIDs>& cmpctblock = pcmpctblock[state.fWantsCmpctWitness];
+        if (!cmpctblock)
+            cmpctblock.reset(new CBlockHeaderAndShortTxIDs(block, state.fWantsCmpctWitness));
+        LogPrint("net", "%s sending header-and-ids %s to peer %d\n", __func__,
+                block.GetHash().ToString(), pnode->id);
+        pnode->PushMessageWithFlag(state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, *cmpctblock);
+        state.pindexBestHeaderSent = pindex;
+    }
+}
+
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
 static bool AcceptBlock(const CBlock& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
 {
@@ -3739,6 +4191,9 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    if (fFastCmpctRelay && dbp == NULL && !IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev)
+        RelayCompactBlockBeforeConnect(block, pindex, chainparams.GetConsensus());
+
     int nHeight = pindex->nHeight;
 
     // Write block to history file
@@ -3783,7 +4238,7 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, C
 {
     {
         LOCK(cs_main);
-        bool fRequested = MarkBlockAsReceived(pblock->GetHash());
+        bool fRequested = MarkBlockAsReceived(pblock->GetHash(), pfrom ? pfrom->GetId() : -1);
         fRequested |= fForceProcessing;
 
         // Store to disk
@@ -4100,9 +4555,13 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // Check whether we have an address index
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+
+    // Check whether we have a spent index
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
@@ -4187,7 +4646,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, true))
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -4360,9 +4819,13 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
+    // Use the provided setting for -addressindex in the new database
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+
+    // Use the provided setting for -spentindex in the new database
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4941,6 +5404,48 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/** Append the headers of the active chain from nHeightStart to nHeightEnd to vData,
+ *  each serialized as a block without transactions. */
+static void SerializeActiveChainHeaders(int nHeightStart, int nHeightEnd, std::vector<char>& vData)
+{
+    AssertLockHeld(cs_main);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    for (int nHeight = nHeightStart; nHeight <= nHeightEnd; nHeight++)
+        ss << CBlock(chainActive[nHeight]->GetBlockHeader());
+    vData.insert(vData.end(), ss.begin(), ss.end());
+}
+
+/** Get the serialized headers of span nSpan, which must be complete in the active chain. */
+static std::shared_ptr<const CSerializedHeaders> GetHeadersCacheSpan(int nSpan)
+{
+    AssertLockHeld(cs_main);
+    const int nHeightStart = nSpan * HEADERS_CACHE_SPAN;
+    const int nHeightEnd = nHeightStart + HEADERS_CACHE_SPAN - 1;
+    assert(nHeightEnd <= chainActive.Height());
+
+    CHeadersCacheEntry& entry = mapHeadersCache[nSpan];
+    entry.nLastUsed = ++nHeadersCacheUses;
+    // The span is still valid as long as its last block is in the active chain
+    if (entry.headers && entry.headers->hashLast == chainActive[nHeightEnd]->GetBlockHash())
+        return entry.headers;
+
+    std::shared_ptr<CSerializedHeaders> headers = std::make_shared<CSerializedHeaders>();
+    headers->hashLast = chainActive[nHeightEnd]->GetBlockHash();
+    SerializeActiveChainHeaders(nHeightStart, nHeightEnd, headers->vData);
+    headers->nEntrySize = headers->vData.size() / HEADERS_CACHE_SPAN;
+    entry.headers = headers;
+
+    if (mapHeadersCache.size() > MAX_HEADERS_CACHE_SPANS) {
+        std::map<int, CHeadersCacheEntry>::iterator itOldest = mapHeadersCache.begin();
+        for (std::map<int, CHeadersCacheEntry>::iterator it = mapHeadersCache.begin(); it != mapHeadersCache.end(); ++it) {
+            if (it->second.nLastUsed < itOldest->second.nLastUsed)
+                itOldest = it;
+        }
+        mapHeadersCache.erase(itOldest);
+    }
+    return headers;
+}
+
 uint32_t GetFetchFlags(CNode* pfrom, CBlockIndex* pprev, const Consensus::Params& chainparams) {
     uint32_t nFetchFlags = 0;
     if ((nLocalServices & NODE_WITNESS) && State(pfrom->GetId())->fHaveWitness) {
@@ -4949,6 +5454,48 @@ uint32_t GetFetchFlags(CNode* pfrom, CBlockIndex* pprev, const Consensus::Params
     return nFetchFlags;
 }
 
+/**
+ * Validate a BIP 157 request for the filters of the active chain up to
+ * hashStop, starting at nStartHeight. Peers asking for filters we do not
+ * serve, or for an invalid range, are disconnected. Returns false (without
+ * disconnecting) when the filter index has not reached the stop block yet.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, int nStartHeight, const uint256& hashStop,
+                                      int nMaxHeightRange, const CBlockIndex*& pindexStop)
+{
+    if (!(nLocalServices & NODE_COMPACT_FILTERS) || !pblockfilterindex ||
+            nFilterType != pblockfilterindex->GetFilterType()) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+            LogPrint("net", "peer %d requested block filters for unknown or stale block %s\n", pfrom->id, hashStop.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        pindexStop = mi->second;
+    }
+
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= nMaxHeightRange) {
+        LogPrint("net", "peer %d requested invalid block filter range %d to %d\n", pfrom->id, nStartHeight, pindexStop->nHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    const CBlockIndex* pindexIndexed = pblockfilterindex->GetBestBlock();
+    if (!pindexIndexed || pindexIndexed->GetAncestor(pindexStop->nHeight) != pindexStop) {
+        LogPrint("net", "ignoring block filter request from peer %d, the block filter index has not reached block %s yet\n",
+                 pfrom->id, hashStop.ToString());
+        return false;
+    }
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -5105,7 +5652,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 		
 		// Relay sync-checkpoint
         {
-            LOCK(cs_hashSyncCheckpoint);
+            // hashCheckpointKnown is written by other message handler threads under cs_vNodes
+            LOCK2(cs_hashSyncCheckpoint, cs_vNodes);
             if (!checkpointMessage.IsNull())
                 checkpointMessage.RelayTo(pfrom);
         }
@@ -5314,7 +5862,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
                     if (CanDirectFetch(chainparams.GetConsensus()) &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER &&
+                        nodestate->nBlocksInFlight < GetBlocksInTransitLimit(nodestate) &&
                         (!IsWitnessEnabled(chainActive.Tip(), chainparams.GetConsensus()) || State(pfrom->GetId())->fHaveWitness)) {
                         inv.type |= nFetchFlags;
                         if (nodestate->fSupportsDesiredCmpctVersion)
@@ -5463,52 +6011,166 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == NetMsgType::GETHEADERS)
+    else if (strCommand == NetMsgType::GETCFILTERS)
     {
-        CBlockLocator locator;
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
         uint256 hashStop;
-        vRecv >> locator >> hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
 
-        LOCK(cs_main);
-        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
-            LogPrint("net", "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->id);
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, (int)std::min(nStartHeight, (uint32_t)std::numeric_limits<int>::max()),
+                                       hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<BlockFilter> vFilters;
+        if (!pblockfilterindex->LookupFilterRange(nStartHeight, pindexStop, vFilters)) {
+            LogPrint("net", "failed to find block filters for range %d to %s\n", nStartHeight, hashStop.ToString());
             return true;
         }
+        BOOST_FOREACH(const BlockFilter& filter, vFilters)
+            pfrom->PushMessage(NetMsgType::CFILTER, filter);
+    }
 
-        CNodeState *nodestate = State(pfrom->GetId());
-        CBlockIndex* pindex = NULL;
-        if (locator.IsNull())
-        {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, (int)std::min(nStartHeight, (uint32_t)std::numeric_limits<int>::max()),
+                                       hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        uint256 prevHeader;
+        if (nStartHeight > 0 && !pblockfilterindex->LookupFilterHeader(pindexStop->GetAncestor(nStartHeight - 1), prevHeader)) {
+            LogPrint("net", "failed to find block filter header at height %d\n", nStartHeight - 1);
+            return true;
+        }
+        std::vector<uint256> vFilterHashes;
+        if (!pblockfilterindex->LookupFilterHashRange(nStartHeight, pindexStop, vFilterHashes)) {
+            LogPrint("net", "failed to find block filter hashes for range %d to %s\n", nStartHeight, hashStop.ToString());
+            return true;
+        }
+        pfrom->PushMessage(NetMsgType::CFHEADERS, nFilterType, hashStop, prevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        const CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<int>::max(), pindexStop))
+            return true;
+
+        std::vector<uint256> vHeaders(pindexStop->nHeight / CFCHECKPT_INTERVAL);
+        const CBlockIndex* pindex = pindexStop;
+        for (int i = vHeaders.size() - 1; i >= 0; i--) {
+            pindex = pindex->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+            if (!pblockfilterindex->LookupFilterHeader(pindex, vHeaders[i])) {
+                LogPrint("net", "failed to find block filter header at height %d\n", pindex->nHeight);
                 return true;
-            pindex = (*mi).second;
+            }
         }
-        else
+        pfrom->PushMessage(NetMsgType::CFCHECKPT, nFilterType, hashStop, vHeaders);
+    }
+
+
+    else if (strCommand == NetMsgType::GETHEADERS)
+    {
+        CBlockLocator locator;
+        uint256 hashStop;
+        vRecv >> locator >> hashStop;
+
+        // Headers are collected as slices of cached spans (plus freshly serialized
+        // ones past the last complete span) under cs_main, and copied into the
+        // message after releasing it.
+        unsigned int nCount = 0;
+        std::vector<std::pair<std::shared_ptr<const CSerializedHeaders>, std::pair<size_t, size_t> > > vSlices;
+        std::vector<char> vTail;
         {
+            LOCK(cs_main);
+            if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+                LogPrint("net", "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->id);
+                return true;
+            }
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            CBlockIndex* pindex = NULL;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi == mapBlockIndex.end())
+                    return true;
+                pindex = (*mi).second;
+
+                LogPrint("net", "getheaders %d to %s from peer=%d\n", pindex->nHeight, hashStop.ToString(), pfrom->id);
+                // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+                vector<CBlock> vHeaders(1, pindex->GetBlockHeader());
+                nodestate->pindexBestHeaderSent = pindex;
+                pfrom->PushMessage(NetMsgType::HEADERS, vHeaders);
+                return true;
+            }
+
             // Find the last block the caller has in the main chain
             pindex = FindForkInGlobalIndex(chainActive, locator);
             if (pindex)
                 pindex = chainActive.Next(pindex);
+
+            LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+            if (pindex) {
+                // Send up to MAX_HEADERS_RESULTS headers, up to and including hashStop
+                // if it is among them
+                int nHeightStart = pindex->nHeight;
+                int nHeightEnd = std::min(chainActive.Height(), nHeightStart + (int)MAX_HEADERS_RESULTS - 1);
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second) &&
+                        mi->second->nHeight >= nHeightStart && mi->second->nHeight < nHeightEnd)
+                    nHeightEnd = mi->second->nHeight;
+                nCount = nHeightEnd - nHeightStart + 1;
+
+                int nHeight = nHeightStart;
+                while (nHeight <= nHeightEnd) {
+                    const int nSpan = nHeight / HEADERS_CACHE_SPAN;
+                    const int nSpanEnd = (nSpan + 1) * HEADERS_CACHE_SPAN - 1;
+                    if (nSpanEnd > chainActive.Height()) {
+                        SerializeActiveChainHeaders(nHeight, nHeightEnd, vTail);
+                        break;
+                    }
+                    std::shared_ptr<const CSerializedHeaders> headers = GetHeadersCacheSpan(nSpan);
+                    const int nSliceEnd = std::min(nSpanEnd, nHeightEnd);
+                    const size_t nOffset = (nHeight - nSpan * HEADERS_CACHE_SPAN) * headers->nEntrySize;
+                    const size_t nSize = (nSliceEnd - nHeight + 1) * headers->nEntrySize;
+                    vSlices.push_back(std::make_pair(headers, std::make_pair(nOffset, nSize)));
+                    nHeight = nSliceEnd + 1;
+                }
+                pindex = chainActive[nHeightEnd];
+            }
+            // pindex can be NULL if our peer has chainActive.Tip() (and thus we are
+            // sending an empty headers message), in which case it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex))
-        {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
+        pfrom->BeginMessage(NetMsgType::HEADERS);
+        try {
+            WriteCompactSize(pfrom->ssSend, nCount);
+            for (size_t i = 0; i < vSlices.size(); i++)
+                pfrom->ssSend.write(&vSlices[i].first->vData[vSlices[i].second.first], vSlices[i].second.second);
+            if (!vTail.empty())
+                pfrom->ssSend.write(&vTail[0], vTail.size());
+            pfrom->EndMessage(NetMsgType::HEADERS);
+        } catch (...) {
+            pfrom->AbortMessage();
+            throw;
         }
-        // pindex can be NULL either if we sent chainActive.Tip() OR
-        // if our peer has chainActive.Tip() (and thus we are sending an empty
-        // headers message). In both cases it's safe to update
-        // pindexBestHeaderSent to be our tip.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        pfrom->PushMessage(NetMsgType::HEADERS, vHeaders);
     }
 
 
@@ -5646,6 +6308,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 assert(recentRejects);
                 recentRejects->insert(tx.GetHash());
             }
+            if (!state.CorruptionPossible() && RecursiveDynamicUsage(tx) < 100000) {
+                // A transaction we reject by policy may still be mined
+                AddToCompactExtraTransactions(std::make_shared<const CTransaction>(tx));
+            }
 
             if (pfrom->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
                 // Always relay transactions received from whitelisted peers, even
@@ -5750,7 +6416,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= chainActive.Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < GetBlocksInTransitLimit(nodestate)) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
                 list<QueuedBlock>::iterator *queuedBlockIt = NULL;
                 if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
@@ -5764,7 +6430,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 }
 
                 PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
-                ReadStatus status = partialBlock.InitData(cmpctblock);
+                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status == READ_STATUS_INVALID) {
                     MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
                     Misbehaving(pfrom->GetId(), 100);
@@ -5807,7 +6473,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 // Optimistically try to reconstruct anyway since we might be
                 // able to without any round trips.
                 PartiallyDownloadedBlock tempBlock(&mempool);
-                ReadStatus status = tempBlock.InitData(cmpctblock);
+                ReadStatus status = tempBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status != READ_STATUS_OK) {
                     // TODO: don't ignore failures
                     return true;
@@ -6021,7 +6687,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             vector<CBlockIndex *> vToFetch;
             CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= (unsigned int)GetBlocksInTransitLimit(nodestate)) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!IsWitnessEnabled(pindexWalk->pprev, chainparams.GetConsensus()) || State(pfrom->GetId())->fHaveWitness)) {
@@ -6042,7 +6708,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 BOOST_REVERSE_FOREACH(CBlockIndex *pindex, vToFetch) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= GetBlocksInTransitLimit(nodestate)) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -6123,7 +6789,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -6236,8 +6905,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (checkpoint.ProcessSyncCheckpoint())
         {
             // Relay
-            pfrom->hashCheckpointKnown = checkpoint.hashCheckpoint;
             LOCK(cs_vNodes);
+            pfrom->hashCheckpointKnown = checkpoint.hashCheckpoint;
             BOOST_FOREACH(CNode* pnode, vNodes)
                 checkpoint.RelayTo(pnode);
         }
@@ -6426,6 +7095,11 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        CMsgProcessTime time;
+        time.nCount = 1;
+        time.nWallMicros = GetTimeMicros();
+        time.nCPUMicros = GetThreadCPUTimeMicros();
+        time.nLockWaitMicros = GetThreadLockWaitMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams);
@@ -6462,6 +7136,10 @@ bool ProcessMessages(CNode* pfrom)
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        time.nWallMicros = GetTimeMicros() - time.nWallMicros;
+        time.nCPUMicros = GetThreadCPUTimeMicros() - time.nCPUMicros;
+        time.nLockWaitMicros = GetThreadLockWaitMicros() - time.nLockWaitMicros;
+        pfrom->RecordProcessTime(strCommand, time);
 
         if (!fRet)
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -6546,28 +7224,36 @@ bool SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
+            vector<CAddress> vAddrNew;
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                LOCK(pto->cs_addrSend);
+                vAddrNew.reserve(pto->vAddrToSend.size());
+                BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        pto->PushMessage(NetMsgType::ADDR, vAddr);
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddrNew.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
+                // we only send the big addr message once
+                if (pto->vAddrToSend.capacity() > 40)
+                    pto->vAddrToSend.shrink_to_fit();
+            }
+            // receiver rejects addr messages larger than 1000
+            vector<CAddress> vAddr;
+            BOOST_FOREACH(const CAddress& addr, vAddrNew)
+            {
+                vAddr.push_back(addr);
+                if (vAddr.size() >= 1000)
+                {
+                    pto->PushMessage(NetMsgType::ADDR, vAddr);
+                    vAddr.clear();
+                }
             }
-            pto->vAddrToSend.clear();
             if (!vAddr.empty())
                 pto->PushMessage(NetMsgType::ADDR, vAddr);
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
         }
 
         CNodeState &state = *State(pto->GetId());
@@ -6906,10 +7592,11 @@ bool SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInTransitLimit = GetBlocksInTransitLimit(&state);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
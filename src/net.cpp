@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -45,6 +49,12 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// Maximum time in milliseconds the socket handler waits for socket events
+#define SOCKET_EVENT_TIMEOUT 50
+
+// Maximum number of epoll events handled per wakeup
+#define MAX_SOCKET_EVENTS 256
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -65,6 +75,16 @@ namespace {
     const int MAX_OUTBOUND_CONNECTIONS = 8;
     const int MAX_FEELER_CONNECTIONS = 1;
 
+    /** Number of large message buffers kept around for reuse */
+    const size_t MAX_NET_BUFFER_POOL = 16;
+    /** Buffers with more capacity than this are freed instead of pooled */
+    const size_t MAX_POOLED_NET_BUFFER = 2 * 1024 * 1024;
+    /** Messages at least this large are sent and received using pooled
+     *  buffers, and received directly into them */
+    const unsigned int MIN_POOLED_NET_MESSAGE = 0x10000;
+    /** Maximum number of queued messages handed to the kernel in one send */
+    const int MAX_SEND_IOVECS = 64;
+
     struct ListenSocket {
         SOCKET socket;
         bool whitelisted;
@@ -91,6 +111,9 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+static int hEpollFd = -1;
+#endif
 CAddrMan addrman;
 int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
 bool fAddressesInitialized = false;
@@ -111,6 +134,10 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
+static boost::mutex messageHandlerMutex;
+
+static CCriticalSection cs_vNetBufferPool;
+static std::vector<CSerializeData> vNetBufferPool;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -330,6 +357,8 @@ uint64_t CNode::nTotalBytesRecv = 0;
 uint64_t CNode::nTotalBytesSent = 0;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
+CCriticalSection CNode::cs_totalProcessTime;
+mapMsgCmdTime CNode::mapTotalProcessTimePerMsgCmd;
 
 uint64_t CNode::nMaxOutboundLimit = 0;
 uint64_t CNode::nMaxOutboundTotalBytesSentInCycle = 0;
@@ -382,6 +411,22 @@ CNode* FindNode(const NodeId nodeid)
     return NULL;
 }
 
+/** Add a new peer's socket to the socket event loop */
+static void RegisterNodeSocket(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    // Peers are edge-triggered: readiness is kept in fRecvReady/fSendReady
+    // until recv/send would block, so sockets are never re-armed or rescanned.
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpollFd, EPOLL_CTL_ADD, pnode->hSocket, &event) == SOCKET_ERROR) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id, NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure)
 {
     if (pszDest == NULL) {
@@ -439,6 +484,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool fCountFailure
         // Add node
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
+        RegisterNodeSocket(pnode);
 
         {
             LOCK(cs_vNodes);
@@ -698,6 +744,10 @@ void CNode::copyStats(CNodeStats &stats)
     X(mapSendBytesPerMsgCmd);
     X(nRecvBytes);
     X(mapRecvBytesPerMsgCmd);
+    {
+        LOCK(cs_processTime);
+        X(mapProcessTimePerMsgCmd);
+    }
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -721,6 +771,30 @@ void CNode::copyStats(CNodeStats &stats)
 }
 #undef X
 
+// Swap a spare pooled buffer, if there is one, into the empty buffer data
+static void TakeNetBuffer(CSerializeData& data)
+{
+    assert(data.empty());
+    LOCK(cs_vNetBufferPool);
+    if (!vNetBufferPool.empty()) {
+        data.swap(vNetBufferPool.back());
+        vNetBufferPool.pop_back();
+    }
+}
+
+// Keep the allocation of data for later messages if it is worth reusing
+static void ReleaseNetBuffer(CSerializeData& data)
+{
+    if (data.capacity() < MIN_POOLED_NET_MESSAGE || data.capacity() > MAX_POOLED_NET_BUFFER)
+        return;
+    data.clear();
+    LOCK(cs_vNetBufferPool);
+    if (vNetBufferPool.size() < MAX_NET_BUFFER_POOL) {
+        vNetBufferPool.push_back(CSerializeData());
+        vNetBufferPool.back().swap(data);
+    }
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 {
@@ -729,7 +803,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, nRecvVersion));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, nRecvVersion);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -762,13 +836,41 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
 
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            // Wake every handler thread: the one that picks this node up may
+            // be busy, and one that is woken skips nodes held by another
+            messageHandlerCondition.notify_all();
         }
     }
 
     return true;
 }
 
+// requires LOCK(cs_vRecvMsg)
+unsigned int CNode::GetDirectRecvSpace(char*& pch)
+{
+    if (vRecvMsg.empty())
+        return 0;
+
+    CNetMessage& msg = vRecvMsg.back();
+    if (!msg.in_data || msg.hdr.nMessageSize - msg.nDataPos < MIN_POOLED_NET_MESSAGE)
+        return 0;
+
+    // Same read-ahead as CNetMessage::readData, so it never has to resize
+    // (and so move) the buffer underneath the data being handed to it.
+    if (msg.vRecv.size() < msg.nDataPos + MIN_POOLED_NET_MESSAGE)
+        msg.vRecv.resize(std::min(msg.hdr.nMessageSize, msg.nDataPos + MIN_POOLED_NET_MESSAGE + 256 * 1024));
+
+    pch = &msg.vRecv[msg.nDataPos];
+    return msg.vRecv.size() - msg.nDataPos;
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData buf;
+    vRecv.swap(buf);
+    ReleaseNetBuffer(buf);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -797,6 +899,14 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    // Large payloads reuse a pooled buffer, which usually already has the
+    // capacity to grow to the full message without reallocating.
+    if (hdr.nMessageSize >= MIN_POOLED_NET_MESSAGE) {
+        CSerializeData buf;
+        TakeNetBuffer(buf);
+        vRecv.swap(buf);
+    }
+
     return nCopy;
 }
 
@@ -810,7 +920,9 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Data received via CNode::GetDirectRecvSpace is already in place
+    if (pch != &vRecv[nDataPos])
+        memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -830,20 +942,49 @@ void SocketSendData(CNode *pnode)
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        assert(it->size() > pnode->nSendOffset);
+#ifdef WIN32
+        size_t nQueued = it->size() - pnode->nSendOffset;
+        int nBytes = send(pnode->hSocket, &(*it)[pnode->nSendOffset], nQueued, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Hand the kernel as many queued messages as possible in one call
+        struct iovec iov[MAX_SEND_IOVECS];
+        int nIov = 0;
+        size_t nQueued = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (std::deque<CSerializeData>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itIov) {
+            iov[nIov].iov_base = &(*itIov)[nOffset];
+            iov[nIov].iov_len = itIov->size() - nOffset;
+            nQueued += iov[nIov].iov_len;
+            nIov++;
+            nOffset = 0;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        int nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            // Retire the messages that went out completely
+            size_t nSent = nBytes;
+            while (nSent > 0) {
+                size_t nRemaining = it->size() - pnode->nSendOffset;
+                if (nSent < nRemaining) {
+                    pnode->nSendOffset += nSent;
+                    break;
+                }
+                nSent -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= it->size();
+                ReleaseNetBuffer(*it);
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            if ((size_t)nBytes < nQueued) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1081,6 +1222,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     pnode->fWhitelisted = whitelisted;
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
+    RegisterNodeSocket(pnode);
 
     {
         LOCK(cs_vNodes);
@@ -1091,6 +1233,9 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+#ifdef USE_EPOLL
+    bool fMoreWork = false;
+#endif
     while (true)
     {
         //
@@ -1156,12 +1301,63 @@ void ThreadSocketHandler()
             uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
+#ifdef USE_EPOLL
+        //
+        // Wait for socket events
+        //
+        // Listen sockets are level-triggered and peers edge-triggered, so a
+        // wakeup only costs O(events) and peers that have nothing to report are
+        // never touched by the kernel. Don't sleep if a peer had more data
+        // buffered than we read last time.
+        struct epoll_event events[MAX_SOCKET_EVENTS];
+        int nEvents = epoll_wait(hEpollFd, events, MAX_SOCKET_EVENTS, fMoreWork ? 0 : SOCKET_EVENT_TIMEOUT);
+        boost::this_thread::interruption_point();
+
+        if (nEvents == SOCKET_ERROR)
+        {
+            if (errno != EINTR)
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(SOCKET_EVENT_TIMEOUT);
+            }
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            bool fListenSocket = false;
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            {
+                if (events[i].data.ptr == &hListenSocket)
+                {
+                    //
+                    // Accept new connections
+                    //
+                    AcceptConnection(hListenSocket);
+                    fListenSocket = true;
+                    break;
+                }
+            }
+            if (fListenSocket)
+                continue;
+
+            // Nodes are only deleted by this thread, after their socket has
+            // been closed and thereby removed from the epoll set, so the
+            // pointer is still valid here.
+            CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fRecvReady = true;
+            if (events[i].events & EPOLLOUT)
+                pnode->fSendReady = true;
+        }
+        fMoreWork = false;
+#else
         //
         // Find which sockets have data to receive
         //
         struct timeval timeout;
         timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+        timeout.tv_usec = SOCKET_EVENT_TIMEOUT * 1000; // frequency to poll pnode->vSend
 
         fd_set fdsetRecv;
         fd_set fdsetSend;
@@ -1248,6 +1444,7 @@ void ThreadSocketHandler()
                 AcceptConnection(hListenSocket);
             }
         }
+#endif
 
         //
         // Service each socket
@@ -1263,27 +1460,58 @@ void ThreadSocketHandler()
         {
             boost::this_thread::interruption_point();
 
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+#ifdef USE_EPOLL
+            // Readiness is sticky, so apply the flow control that the select()
+            // loop expresses through its fd sets here: drain a pending send
+            // buffer before receiving more, and stop receiving while the
+            // receive buffer is full.
+            bool fSendPending = false;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                fSendPending = lockSend && !pnode->vSendMsg.empty();
+            }
+            bool fRecv = pnode->fRecvReady && !fSendPending;
+            bool fSend = pnode->fSendReady && fSendPending;
+#else
+            bool fRecv = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+            bool fSend = FD_ISSET(pnode->hSocket, &fdsetSend);
+#endif
+
             //
             // Receive
             //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (fRecv)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (lockRecv
+#ifdef USE_EPOLL
+                    && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                        pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+#endif
+                    )
                 {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // The bulk of a large message is read straight into its payload buffer
+                        char* pchRecv = pchBuf;
+                        unsigned int nRecvSpace = pnode->GetDirectRecvSpace(pchRecv);
+                        if (nRecvSpace == 0)
+                            nRecvSpace = sizeof(pchBuf);
+                        int nBytes = recv(pnode->hSocket, pchRecv, nRecvSpace, MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            if (!pnode->ReceiveMsgBytes(pchRecv, nBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+#ifdef USE_EPOLL
+                            // More may be queued; keep reading until recv would block.
+                            fMoreWork = true;
+#endif
                         }
                         else if (nBytes == 0)
                         {
@@ -1296,7 +1524,9 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fRecvReady = false;
+                            else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1312,11 +1542,15 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (fSend)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend) {
                     SocketSendData(pnode);
+                    // Anything left over means the kernel buffer is full again.
+                    if (!pnode->vSendMsg.empty())
+                        pnode->fSendReady = false;
+                }
             }
 
             //
@@ -1849,11 +2083,8 @@ bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSem
 }
 
 
-void ThreadMessageHandler()
+void ThreadMessageHandler(int nThread)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-
     while (true)
     {
         std::vector<CNode*> vNodesCopy;
@@ -1867,11 +2098,19 @@ void ThreadMessageHandler()
 
         bool fSleep = true;
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Each handler thread starts at a different node so they don't all
+        // contend for the same peers first.
+        for (size_t i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(i + nThread) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            // Another handler thread is busy with this node
+            TRY_LOCK(pnode->cs_messageHandler, lockHandler);
+            if (!lockHandler)
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1906,8 +2145,10 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
+        if (fSleep) {
+            boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        }
     }
 }
 
@@ -2065,8 +2306,28 @@ void static Discover(boost::thread_group& threadGroup)
 #endif
 }
 
-void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
+bool StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
+#ifdef USE_EPOLL
+    if (hEpollFd == -1) {
+        hEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpollFd == -1) {
+            LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = &hListenSocket;
+            if (epoll_ctl(hEpollFd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR) {
+                LogPrintf("epoll_ctl failed for listening socket: %s\n", NetworkErrorString(errno));
+                return false;
+            }
+        }
+    }
+#endif
+
+
     uiInterface.InitMessage(_("Loading addresses..."));
     // Load addresses from peers.dat
     int64_t nStart = GetTimeMillis();
@@ -2135,11 +2396,18 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Initiate outbound connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
-    // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    // Process messages. Different peers are serviced concurrently, each
+    // peer by one thread at a time; handlers that need cs_main still run
+    // one after another.
+    int nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandthreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+    LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
+
+    return true;
 }
 
 bool StopNode()
@@ -2174,6 +2442,12 @@ public:
             if (hListenSocket.socket != INVALID_SOCKET)
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef USE_EPOLL
+        if (hEpollFd != -1) {
+            close(hEpollFd);
+            hEpollFd = -1;
+        }
+#endif
 
         // clean up some globals (to help leak detection)
         BOOST_FOREACH(CNode *pnode, vNodes)
@@ -2213,6 +2487,24 @@ void CNode::RecordBytesRecv(uint64_t bytes)
     nTotalBytesRecv += bytes;
 }
 
+void CNode::RecordProcessTime(const std::string& strCommand, const CMsgProcessTime& time)
+{
+    // Like received bytes, unknown message types are accounted together
+    const std::string& strKey = mapRecvBytesPerMsgCmd.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+    {
+        LOCK(cs_processTime);
+        mapProcessTimePerMsgCmd[strKey] += time;
+    }
+    LOCK(cs_totalProcessTime);
+    mapTotalProcessTimePerMsgCmd[strKey] += time;
+}
+
+mapMsgCmdTime CNode::GetTotalProcessTime()
+{
+    LOCK(cs_totalProcessTime);
+    return mapTotalProcessTimePerMsgCmd;
+}
+
 void CNode::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
@@ -2471,6 +2763,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nServices = NODE_NONE;
     nServicesExpected = NODE_NONE;
     hSocket = hSocketIn;
+    fRecvReady = false;
+    fSendReady = false;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2633,7 +2927,16 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
     std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
+    if (ssSend.size() >= MIN_POOLED_NET_MESSAGE) {
+        // Queue large messages without copying them, and carry on
+        // serializing into a spare buffer from the pool
+        ssSend.swap(*it);
+        CSerializeData buf;
+        TakeNetBuffer(buf);
+        ssSend.swap(buf);
+    } else {
+        ssSend.GetAndClear(*it);
+    }
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
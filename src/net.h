@@ -73,6 +73,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 2;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -95,7 +99,7 @@ bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSem
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
-void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
+bool StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
 
@@ -188,6 +192,27 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Time spent in ProcessMessage on messages of one type */
+struct CMsgProcessTime
+{
+    uint64_t nCount;
+    int64_t nWallMicros;            //!< Wall-clock time
+    int64_t nCPUMicros;             //!< CPU time of the handling thread
+    int64_t nLockWaitMicros;        //!< Time blocked on contended locks (mostly cs_main)
+
+    CMsgProcessTime() : nCount(0), nWallMicros(0), nCPUMicros(0), nLockWaitMicros(0) {}
+
+    CMsgProcessTime& operator+=(const CMsgProcessTime& other)
+    {
+        nCount += other.nCount;
+        nWallMicros += other.nWallMicros;
+        nCPUMicros += other.nCPUMicros;
+        nLockWaitMicros += other.nLockWaitMicros;
+        return *this;
+    }
+};
+typedef std::map<std::string, CMsgProcessTime> mapMsgCmdTime; //command, processing time
+
 class CNodeStats
 {
 public:
@@ -207,6 +232,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdTime mapProcessTimePerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -238,6 +264,8 @@ public:
         nTime = 0;
     }
 
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -325,6 +353,11 @@ public:
     ServiceFlags nServices;
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
+    // Readiness of hSocket as last reported by the socket event loop. Under
+    // epoll these stay set until a recv/send would block. Only used by
+    // ThreadSocketHandler.
+    bool fRecvReady;
+    bool fSendReady;
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -335,6 +368,9 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Held by the message handler thread that is servicing this node, so a
+    // peer's messages are processed and answered in order by one thread at a time
+    CCriticalSection cs_messageHandler;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -387,6 +423,8 @@ protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    CCriticalSection cs_processTime;
+    mapMsgCmdTime mapProcessTimePerMsgCmd;
 
     // Basic fuzz-testing
     void Fuzz(int nChance); // modifies ssSend
@@ -396,13 +434,16 @@ public:
     int nStartingHeight;
 
     // flood relay
+    // Addresses are pushed to a node by the handler threads of other nodes
+    // too, so vAddrToSend and addrKnown are guarded by cs_addrSend
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
+    CCriticalSection cs_addrSend;
     bool fGetAddr;
     std::set<uint256> setKnown;
     int64_t nNextAddrSend;
     int64_t nNextLocalAddrSend;
-    uint256 hashCheckpointKnown;
+    uint256 hashCheckpointKnown; // protected by cs_vNodes
 
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
@@ -456,6 +497,8 @@ private:
     static CCriticalSection cs_totalBytesSent;
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
+    static CCriticalSection cs_totalProcessTime;
+    static mapMsgCmdTime mapTotalProcessTimePerMsgCmd;
 
     // outbound limit & stats
     static uint64_t nMaxOutboundTotalBytesSentInCycle;
@@ -492,6 +535,11 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
 
+    // requires LOCK(cs_vRecvMsg)
+    // Space in the payload buffer of a large message still being received,
+    // so the socket can be read straight into it; 0 if none.
+    unsigned int GetDirectRecvSpace(char*& pch);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -515,6 +563,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(addr.GetKey());
     }
 
@@ -523,6 +572,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
@@ -793,6 +843,11 @@ public:
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
 
+    //!account time spent processing a message of type strCommand from this node
+    void RecordProcessTime(const std::string& strCommand, const CMsgProcessTime& time);
+    //!time spent processing messages from all nodes, by message type
+    static mapMsgCmdTime GetTotalProcessTime();
+
     //!set the max outbound target in bytes
     static void SetMaxOutboundTarget(uint64_t limit);
     static uint64_t GetMaxOutboundTarget();
@@ -243,6 +243,39 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a filter type, a start height and a stop hash.
+ * Peer should respond with a "cfilter" message for each block in the range.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP 157
+ */
+extern const char *GETCFILTERS;
+/**
+ * Contains the compact filter of a block.
+ * Sent in response to a "getcfilters" message.
+ */
+extern const char *CFILTER;
+/**
+ * Contains a filter type, a start height and a stop hash.
+ * Peer should respond with a "cfheaders" message.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP 157
+ */
+extern const char *GETCFHEADERS;
+/**
+ * Contains the filter header before the requested range and the filter hashes
+ * of the blocks in it. Sent in response to a "getcfheaders" message.
+ */
+extern const char *CFHEADERS;
+/**
+ * Contains a filter type and a stop hash.
+ * Peer should respond with a "cfcheckpt" message.
+ * Only available with service bit NODE_COMPACT_FILTERS, as described by BIP 157
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * Contains the filter headers of every 1000th block up to the stop hash.
+ * Sent in response to a "getcfcheckpt" message.
+ */
+extern const char *CFCHECKPT;
 /**
  * Contains a checkpoint braodcasted by a central checkpointing node
  */
@@ -271,6 +304,9 @@ enum ServiceFlags : uint64_t {
     // Indicates that a node can be asked for blocks and transactions including
     // witness data.
     NODE_WITNESS = (1 << 3),
+    // NODE_COMPACT_FILTERS means the node will serve basic block filters and
+    // filter headers, see BIP 157 and BIP 158.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
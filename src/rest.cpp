@@ -3,20 +3,28 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
+#include "blockfilterindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "init.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <atomic>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/dynamic_bitset.hpp>
 
 #include <univalue.h>
@@ -24,6 +32,13 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_HEADERS_RESULTS = 2000;
+static const int MAX_REST_BLOCKRANGE = 10000;
+//! Block range exports running at once. Each keeps an HTTP worker thread for as long as it runs,
+//! so this leaves the other DEFAULT_HTTP_THREADS for RPC and other REST calls.
+static const int MAX_REST_BLOCKRANGE_EXPORTS = 2;
+
+static std::atomic<int> nBlockRangeExports(0);
 
 enum RetFormat {
     RF_UNDEF,
@@ -59,11 +74,12 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSONStream(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSONStream(CJSONStreamWriter& writer, bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue SpentInfoToJSON(const CSpentIndexValue& value);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message)
 {
@@ -126,6 +142,48 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+static bool rest_headers_reply(HTTPRequest* req,
+                               const RetFormat rf,
+                               const std::vector<const CBlockIndex *>& headers)
+{
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_FOREACH(const CBlockIndex *pindex, headers) {
+        ssHeader << pindex->GetBlockHeader();
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        BOOST_FOREACH(const CBlockIndex *pindex, headers) {
+            jsonHeaders.push_back(blockheaderToJSON(pindex));
+        }
+        string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -140,7 +198,7 @@ static bool rest_headers(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
     long count = strtol(path[0].c_str(), NULL, 10);
-    if (count < 1 || count > 2000)
+    if (count < 1 || count > MAX_REST_HEADERS_RESULTS)
         return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
 
     string hashStr = path[1];
@@ -162,42 +220,104 @@ static bool rest_headers(HTTPRequest* req,
         }
     }
 
-    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-    BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-        ssHeader << pindex->GetBlockHeader();
-    }
+    return rest_headers_reply(req, rf, headers);
+}
 
-    switch (rf) {
-    case RF_BINARY: {
-        string binaryHeader = ssHeader.str();
-        req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryHeader);
-        return true;
-    }
+static bool rest_headerrange(HTTPRequest* req,
+                             const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
 
-    case RF_HEX: {
-        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
-        req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
-        return true;
+    int nStart, nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/headerrange/<start>/<count>.<ext>");
+    if (nCount < 1 || nCount > MAX_REST_HEADERS_RESULTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[1]);
+
+    std::vector<const CBlockIndex *> headers;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight <= chainActive.Height() && (int)headers.size() < nCount; nHeight++)
+            headers.push_back(chainActive[nHeight]);
     }
-    case RF_JSON: {
-        UniValue jsonHeaders(UniValue::VARR);
-        BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-            jsonHeaders.push_back(blockheaderToJSON(pindex));
+
+    return rest_headers_reply(req, rf, headers);
+}
+
+/**
+ * Stream the blocks of the active chain from a height on, each followed by
+ * its undo data, both as stored in the block files. The blocks are read one
+ * at a time and sent as they are read, and no lock is held while doing so.
+ */
+static bool rest_blockrange(HTTPRequest* req,
+                            const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    int nStart, nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockrange/<start>/<count>.bin");
+    if (nCount < 1 || nCount > MAX_REST_BLOCKRANGE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+    if (rf != RF_BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+
+    std::vector<const CBlockIndex *> blocks;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight <= chainActive.Height() && (int)blocks.size() < nCount; nHeight++) {
+            const CBlockIndex *pindex = chainActive[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (pindex->pprev && !(pindex->nStatus & BLOCK_HAVE_UNDO)))
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block at height %d not available (pruned data)", nHeight));
+            blocks.push_back(pindex);
         }
-        string strJSON = jsonHeaders.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
-    }
-    default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
     }
+
+    if (++nBlockRangeExports > MAX_REST_BLOCKRANGE_EXPORTS) {
+        nBlockRangeExports--;
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Too many block range exports in progress, try again later");
     }
 
-    // not reached
-    return true; // continue to process further HTTP reqs on this cxn
+    const CMessageHeader::MessageStartChars& messageStart = Params().MessageStart();
+    std::vector<unsigned char> vchData, vchUndo;
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->StartChunkedReply(HTTP_OK);
+    size_t nSent = 0;
+    BOOST_FOREACH(const CBlockIndex *pindex, blocks) {
+        if (ShutdownRequested())
+            break;
+        if (!ReadRawBlockFromDisk(vchData, pindex, messageStart))
+            break;
+        if (pindex->pprev) {
+            if (!ReadRawUndoFromDisk(vchUndo, pindex, messageStart))
+                break;
+        } else {
+            // The genesis block has no undo data, send an empty CBlockUndo
+            vchUndo.assign(1, 0);
+        }
+        vchData.insert(vchData.end(), vchUndo.begin(), vchUndo.end());
+        if (!req->WriteChunk((const char*)&vchData[0], vchData.size()))
+            break;
+        nSent++;
+    }
+    // The status was sent already, so a reply that stops early must not look
+    // complete: drop the connection instead of sending the final chunk
+    if (nSent == blocks.size())
+        req->EndChunkedReply();
+    else
+        req->AbortChunkedReply();
+    nBlockRangeExports--;
+    return true;
 }
 
 static bool rest_block(HTTPRequest* req,
@@ -223,11 +343,11 @@ static bool rest_block(HTTPRequest* req,
         pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
+    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
 
@@ -247,10 +367,12 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
+        CJSONStreamWriter writer(boost::bind(&HTTPRequest::WriteBody, req, _1, _2));
+        blockToJSONStream(writer, block, pblockindex, showTxDetails);
+        writer.Raw("\n");
+        writer.Flush();
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK);
         return true;
     }
 
@@ -335,11 +457,12 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
+        CJSONStreamWriter writer(boost::bind(&HTTPRequest::WriteBody, req, _1, _2));
+        mempoolToJSONStream(writer, true);
+        writer.Raw("\n");
+        writer.Flush();
         req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        req->WriteReply(HTTP_OK);
         return true;
     }
     default: {
@@ -362,6 +485,9 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    if (ptxindex)
+        ptxindex->BlockUntilSyncedToCurrentChain();
+
     CTransaction tx;
     uint256 hashBlock = uint256();
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
@@ -599,6 +725,209 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_spentinfo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // The output is given as <txid>-<n>
+    size_t pos = param.find('-');
+    uint256 txid;
+    int32_t nOutput;
+    if (pos == std::string::npos || !ParseHashStr(param.substr(0, pos), txid) || !ParseInt32(param.substr(pos + 1), &nOutput) || nOutput < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid output: " + param);
+
+    if (!fSpentIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled");
+
+    CSpentIndexValue value;
+    if (!GetSpentIndex(CSpentIndexKey(txid, nOutput), value))
+        return RESTERR(req, HTTP_NOT_FOUND, param + " not spent");
+
+    switch (rf) {
+    case RF_JSON: {
+        string strJSON = SpentInfoToJSON(value).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockfilter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilter/<filtertype>/<blockhash>.<ext>");
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(path[0], filterType))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[1], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+
+    if (!pblockfilterindex || pblockfilterindex->GetFilterType() != filterType)
+        return RESTERR(req, HTTP_NOT_FOUND, "Index is not enabled for filtertype " + path[0]);
+
+    pblockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return RESTERR(req, HTTP_NOT_FOUND, path[1] + " not found");
+        pindex = it->second;
+    }
+
+    BlockFilter filter;
+    if (!pblockfilterindex->LookupFilter(pindex, filter))
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter of block " + path[1] + " not found, the index may still be syncing");
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssFilter(SER_NETWORK, PROTOCOL_VERSION);
+        ssFilter << filter;
+        string binaryFilter = ssFilter.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryFilter);
+        return true;
+    }
+
+    case RF_HEX: {
+        CDataStream ssFilter(SER_NETWORK, PROTOCOL_VERSION);
+        ssFilter << filter;
+        string strHex = HexStr(ssFilter.begin(), ssFilter.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+        string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockfilterheaders(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilterheaders/<filtertype>/<count>/<blockhash>.<ext>");
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(path[0], filterType))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_REST_HEADERS_RESULTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[1]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[2], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[2]);
+
+    if (!pblockfilterindex || pblockfilterindex->GetFilterType() != filterType)
+        return RESTERR(req, HTTP_NOT_FOUND, "Index is not enabled for filtertype " + path[0]);
+
+    pblockfilterindex->BlockUntilSyncedToCurrentChain();
+
+    std::vector<const CBlockIndex *> blocks;
+    blocks.reserve(count);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
+        while (pindex != NULL && chainActive.Contains(pindex)) {
+            blocks.push_back(pindex);
+            if (blocks.size() == (unsigned long)count)
+                break;
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    std::vector<uint256> vHeaders;
+    vHeaders.reserve(blocks.size());
+    BOOST_FOREACH(const CBlockIndex *pindex, blocks) {
+        uint256 header;
+        if (!pblockfilterindex->LookupFilterHeader(pindex, header))
+            break;
+        vHeaders.push_back(header);
+    }
+    if (vHeaders.empty() && !blocks.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter headers not found, the index may still be syncing");
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_FOREACH(const uint256& header, vHeaders)
+            ssHeader << header;
+        string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RF_HEX: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_FOREACH(const uint256& header, vHeaders)
+            ssHeader << header;
+        string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        BOOST_FOREACH(const uint256& header, vHeaders)
+            jsonHeaders.push_back(header.GetHex());
+        string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -610,7 +939,12 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/headerrange/", rest_headerrange},
+      {"/rest/blockrange/", rest_blockrange},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/spentinfo/", rest_spentinfo},
+      {"/rest/blockfilter/", rest_blockfilter},
+      {"/rest/blockfilterheaders/", rest_blockfilterheaders},
 };
 
 bool StartREST()
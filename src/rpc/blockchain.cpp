@@ -12,7 +12,9 @@
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -62,14 +64,29 @@ double GetDifficulty(const CBlockIndex* blockindex)
     return dDiff;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+/**
+ * The confirmations of a block and its successor on the active chain. Only
+ * these depend on the chain; the rest of a block index entry does not change
+ * once it is added, so the JSON of a block is built without holding cs_main.
+ */
+static void ChainPositionOf(const CBlockIndex* blockindex, int& confirmations, const CBlockIndex*& pnext)
 {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
-    int confirmations = -1;
+    LOCK(cs_main);
+    confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    pnext = chainActive.Next(blockindex);
+}
+
+UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    UniValue result(UniValue::VOBJ);
+    int confirmations;
+    const CBlockIndex* pnext;
+    ChainPositionOf(blockindex, confirmations, pnext);
+
+    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
@@ -84,20 +101,19 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** The fields of a block before and after its "tx" array */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result, UniValue& resultTail)
 {
-    UniValue result(UniValue::VOBJ);
+    int confirmations;
+    const CBlockIndex* pnext;
+    ChainPositionOf(blockindex, confirmations, pnext);
+
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
-    int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
@@ -106,34 +122,65 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx.GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+
+    resultTail.push_back(Pair("time", block.GetBlockTime()));
+    resultTail.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    resultTail.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    resultTail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    resultTail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    resultTail.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+        resultTail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        resultTail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue resultTail(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, result, resultTail);
+
+    UniValue txs(UniValue::VARR);
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+        txs.push_back(blockTxToJSON(tx, txDetails));
+    result.push_back(Pair("tx", txs));
+    result.pushKVs(resultTail);
     return result;
 }
 
+/**
+ * Write a block as blockToJSON would return it, one transaction at a time,
+ * so the JSON of all transactions is never held at once.
+ */
+void blockToJSONStream(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ);
+    UniValue resultTail(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, result, resultTail);
+
+    writer.BeginObject();
+    writer.Members(result);
+    writer.Key("tx");
+    writer.BeginArray();
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+        writer.Value(blockTxToJSON(tx, txDetails));
+    writer.EndArray();
+    writer.Members(resultTail);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -267,6 +314,34 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** Write the mempool as mempoolToJSON would return it, one entry at a time */
+void mempoolToJSONStream(CJSONStreamWriter& writer, bool fVerbose = false)
+{
+    if (fVerbose)
+    {
+        LOCK(mempool.cs);
+        writer.BeginObject();
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        {
+            const uint256& hash = e.GetTx().GetHash();
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(info, e);
+            writer.KeyValue(hash.ToString(), info);
+        }
+        writer.EndObject();
+    }
+    else
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        writer.BeginArray();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            writer.Value(hash.ToString());
+        writer.EndArray();
+    }
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -298,6 +373,19 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+static bool getrawmempoolstream(const UniValue& params, CJSONStreamWriter& writer)
+{
+    if (params.size() > 1)
+        return false;
+
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    mempoolToJSONStream(writer, fVerbose);
+    return true;
+}
+
 UniValue getmempoolancestors(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2) {
@@ -518,8 +606,6 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -527,10 +613,14 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
 
     if (!fVerbose)
     {
@@ -543,6 +633,32 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+/**
+ * Look up and read a block for an RPC call. cs_main is only held for the
+ * lookup; the block is read from disk after releasing it. If the block file
+ * gets pruned in between, the read fails and so does the call.
+ */
+static CBlockIndex* ReadBlockChecked(const uint256& hash, CBlock& block)
+{
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+        pblockindex = mi->second;
+
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+    }
+
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -584,8 +700,6 @@ UniValue getblock(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -593,17 +707,8 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    CBlockIndex* pblockindex = ReadBlockChecked(hash, block);
 
     if (!fVerbose)
     {
@@ -616,6 +721,20 @@ UniValue getblock(const UniValue& params, bool fHelp)
     return blockToJSON(block, pblockindex);
 }
 
+static bool getblockstream(const UniValue& params, CJSONStreamWriter& writer)
+{
+    // The hex encoding of a block is a single string, left to getblock
+    if (params.size() < 1 || params.size() > 2 || (params.size() > 1 && !params[1].get_bool()))
+        return false;
+
+    uint256 hash(uint256S(params[0].get_str()));
+    CBlock block;
+    CBlockIndex* pblockindex = ReadBlockChecked(hash, block);
+
+    blockToJSONStream(writer, block, pblockindex);
+    return true;
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -748,8 +867,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             + HelpExampleRpc("gettxout", "\"txid\", 1")
         );
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = params[0].get_str();
@@ -759,22 +876,28 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
+    // Copy the coins and the best block under the lock, build the reply after
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+    CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoins(hash, coins))
+                return NullUniValue;
+            mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        } else {
+            if (!pcoinsTip->GetCoins(hash, coins))
+                return NullUniValue;
+        }
+        if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
             return NullUniValue;
+
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        pindex = it->second;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
@@ -1111,6 +1234,56 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getvalidationcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getvalidationcacheinfo\n"
+            "\nReturns size and effectiveness statistics of the script validation caches.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sigcache\": {\n"
+            "    \"maxentries\": xxxxx,       (numeric) Number of entries the signature cache can hold\n"
+            "    \"usage\": xxxxx,            (numeric) Memory allocated for the signature cache, in bytes\n"
+            "    \"hits\": xxxxx,             (numeric) Signature lookups answered from the cache\n"
+            "    \"misses\": xxxxx,           (numeric) Signature lookups that required verification\n"
+            "    \"inserts\": xxxxx           (numeric) Verified signatures added to the cache\n"
+            "  },\n"
+            "  \"scriptexeccache\": {\n"
+            "    \"maxentries\": xxxxx,       (numeric) Number of entries the script execution cache can hold\n"
+            "    \"usage\": xxxxx,            (numeric) Memory allocated for the script execution cache, in bytes\n"
+            "    \"hits\": xxxxx,             (numeric) Block transactions whose scripts were skipped as already validated\n"
+            "    \"misses\": xxxxx,           (numeric) Block transactions whose scripts had to be executed\n"
+            "    \"inserts\": xxxxx           (numeric) Fully validated transactions added to the cache\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationcacheinfo", "")
+            + HelpExampleRpc("getvalidationcacheinfo", "")
+        );
+
+    ValidationCacheStats sigstats = GetValidationCacheStats();
+    UniValue sigcache(UniValue::VOBJ);
+    sigcache.push_back(Pair("maxentries", (int64_t)sigstats.nMaxEntries));
+    sigcache.push_back(Pair("usage", (int64_t)sigstats.nBytes));
+    sigcache.push_back(Pair("hits", (int64_t)sigstats.nHits));
+    sigcache.push_back(Pair("misses", (int64_t)sigstats.nMisses));
+    sigcache.push_back(Pair("inserts", (int64_t)sigstats.nInserts));
+
+    ValidationCacheStats scriptstats = GetScriptExecutionCacheStats();
+    UniValue scriptexeccache(UniValue::VOBJ);
+    scriptexeccache.push_back(Pair("maxentries", (int64_t)scriptstats.nMaxEntries));
+    scriptexeccache.push_back(Pair("usage", (int64_t)scriptstats.nBytes));
+    scriptexeccache.push_back(Pair("hits", (int64_t)scriptstats.nHits));
+    scriptexeccache.push_back(Pair("misses", (int64_t)scriptstats.nMisses));
+    scriptexeccache.push_back(Pair("inserts", (int64_t)scriptstats.nInserts));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("sigcache", sigcache));
+    ret.push_back(Pair("scriptexeccache", scriptexeccache));
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1187,28 +1360,29 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true  },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,       NULL,                  false },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,       NULL,                  true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,       NULL,                  true  },
+    { "blockchain",         "getblock",               &getblock,               true,       &getblockstream,       true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,       NULL,                  true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,       NULL,                  true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,       NULL,                  false },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,       NULL,                  true  },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,       NULL,                  false },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,       NULL,                  false },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,       NULL,                  true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,       NULL,                  false },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       &getrawmempoolstream,  false },
+    { "blockchain",         "gettxout",               &gettxout,               true,       NULL,                  true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,       NULL,                  false },
+    { "blockchain",         "getvalidationcacheinfo", &getvalidationcacheinfo, true,       NULL,                  false },
+    { "blockchain",         "verifychain",            &verifychain,            true,       NULL,                  false },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,       NULL,                  false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,       NULL,                  false },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
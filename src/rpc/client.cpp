@@ -72,6 +72,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listunspent", 2 },
     { "getblock", 1 },
     { "getblockheader", 1 },
+    { "getaddressbalance", 0 },
+    { "getaddressutxos", 0 },
+    { "getaddresstxids", 0 },
+    { "getaddressdeltas", 0 },
+    { "getspentinfo", 0 },
     { "gettransaction", 1 },
     { "getrawtransaction", 1 },
     { "createrawtransaction", 0 },
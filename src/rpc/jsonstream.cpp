@@ -0,0 +1,111 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn) :
+    sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false)
+{
+    strBuffer.reserve(nChunkSize);
+}
+
+void CJSONStreamWriter::Append(const std::string& str)
+{
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize)
+        Flush();
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    sink(strBuffer.data(), strBuffer.size());
+    strBuffer.clear();
+}
+
+void CJSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            strBuffer += ",";
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    Append("{");
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Append("}");
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    Append("[");
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Append("]");
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    BeginValue();
+    // A string value is written with the escaping and quotes a key needs
+    Append(UniValue(key).write() + ":");
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    switch (value.getType()) {
+    case UniValue::VOBJ:
+        BeginObject();
+        Members(value);
+        EndObject();
+        break;
+    case UniValue::VARR:
+        BeginArray();
+        for (size_t i = 0; i < value.size(); i++)
+            Value(value[i]);
+        EndArray();
+        break;
+    default:
+        BeginValue();
+        Append(value.write());
+        break;
+    }
+}
+
+void CJSONStreamWriter::Members(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    for (size_t i = 0; i < keys.size(); i++)
+        KeyValue(keys[i], obj[i]);
+}
+
+void CJSONStreamWriter::Raw(const std::string& str)
+{
+    Append(str);
+}
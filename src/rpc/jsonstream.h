@@ -0,0 +1,64 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCJSONSTREAM_H
+#define BITCOIN_RPCJSONSTREAM_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/** Size at which buffered JSON is handed to the sink */
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Serializes JSON incrementally, handing it to a sink in chunks, so large
+ * replies never exist as a single string. Output is the same as that of
+ * UniValue::write() without indentation.
+ *
+ * Values are written either whole (Value) or piece by piece with the
+ * Begin/End and Key calls, which lets large arrays and objects be written one
+ * element at a time.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef boost::function<void(const char* data, size_t size)> Sink;
+
+    CJSONStreamWriter(const Sink& sinkIn, size_t nChunkSizeIn = JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Write the key of the next member of the current object */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    void KeyValue(const std::string& key, const UniValue& value) { Key(key); Value(value); }
+    /** Write the members of an object into the current object */
+    void Members(const UniValue& obj);
+    /** Write text as is, e.g. the trailing newline of a reply */
+    void Raw(const std::string& str);
+
+    /** Hand everything buffered to the sink */
+    void Flush();
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    /** For each open array or object, whether it has no elements yet */
+    std::vector<bool> vEmpty;
+    /** Whether a key was written and its value is pending */
+    bool fAfterKey;
+
+    void BeginValue();
+    void Append(const std::string& str);
+};
+
+#endif // BITCOIN_RPCJSONSTREAM_H
@@ -922,21 +922,21 @@ UniValue estimatesmartpriority(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-
-    { "generating",         "generate",               &generate,               true  },
-    { "generating",         "generatetoaddress",      &generatetoaddress,      true  },
-
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
-    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,       NULL,                  false },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,       NULL,                  false },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,       NULL,                  false },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,       NULL,                  false },
+    { "mining",             "submitblock",            &submitblock,            true,       NULL,                  false },
+
+    { "generating",         "generate",               &generate,               true,       NULL,                  false },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      true,       NULL,                  false },
+
+    { "util",               "estimatefee",            &estimatefee,            true,       NULL,                  false },
+    { "util",               "estimatepriority",       &estimatepriority,       true,       NULL,                  false },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,       NULL,                  false },
+    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true,       NULL,                  false },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &tableRPC)
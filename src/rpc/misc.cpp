@@ -11,6 +11,7 @@
 #include "netbase.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "checkpointsync.h"
@@ -509,19 +510,396 @@ UniValue sendcheckpoint(const UniValue& params, bool fHelp)
     return result;
 }
 
+/** Parse the addresses argument of the getaddress* calls: an address, or {"addresses": [...]} */
+static vector<pair<int, uint160> > AddressesFromParam(const UniValue& param)
+{
+    vector<string> vstrAddresses;
+    if (param.isStr()) {
+        vstrAddresses.push_back(param.get_str());
+    } else if (param.isObject()) {
+        const UniValue& addresses = find_value(param.get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (size_t i = 0; i < addresses.size(); i++)
+            vstrAddresses.push_back(addresses[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with addresses");
+    }
+
+    vector<pair<int, uint160> > vAddresses;
+    BOOST_FOREACH(const string& strAddress, vstrAddresses) {
+        CBitcoinAddress address(strAddress);
+        CKeyID keyID;
+        if (address.GetKeyID(keyID)) {
+            vAddresses.push_back(make_pair((int)ADDRESS_INDEX_PUBKEYHASH, (uint160)keyID));
+        } else if (address.IsScript()) {
+            vAddresses.push_back(make_pair((int)ADDRESS_INDEX_SCRIPTHASH, (uint160)boost::get<CScriptID>(address.Get())));
+        } else {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + strAddress);
+        }
+    }
+    return vAddresses;
+}
+
+static string AddressIndexToString(int type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/**
+ * The address index as of the current tip. ConnectBlock and DisconnectBlock
+ * write the index under cs_main, so a database snapshot and the tip are taken
+ * together under cs_main. The index is then read from the snapshot without
+ * holding cs_main.
+ */
+class CAddressIndexSnapshot
+{
+public:
+    const leveldb::Snapshot* snapshot;
+    const CBlockIndex* pindexTip;
+
+    CAddressIndexSnapshot()
+    {
+        LOCK(cs_main);
+        snapshot = pblocktree->GetSnapshot();
+        pindexTip = chainActive.Tip();
+    }
+
+    ~CAddressIndexSnapshot()
+    {
+        pblocktree->ReleaseSnapshot(snapshot);
+    }
+
+    /** Add the tip the index was read at to a result */
+    void PushChainInfo(UniValue& result) const
+    {
+        result.push_back(Pair("hash", pindexTip->GetBlockHash().GetHex()));
+        result.push_back(Pair("height", pindexTip->nHeight));
+    }
+
+    void ReadUnspent(const vector<pair<int, uint160> >& vAddresses, vector<pair<CAddressUnspentKey, CAddressUnspentValue> >& vUnspent) const
+    {
+        for (size_t i = 0; i < vAddresses.size(); i++) {
+            if (!pblocktree->ReadAddressUnspentIndex(vAddresses[i].first, vAddresses[i].second, vUnspent, snapshot))
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+        }
+    }
+};
+
+/** Read the address index for the addresses argument */
+static void ReadAddressIndexParams(const UniValue& param, const CAddressIndexSnapshot& view, vector<pair<int, uint160> >& vAddresses,
+                                   vector<pair<CAddressIndexKey, CAmount> >& vIndex)
+{
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex and -reindex-chainstate");
+
+    vAddresses = AddressesFromParam(param);
+    int nStartHeight = 0, nEndHeight = 0;
+    if (param.isObject()) {
+        const UniValue& start = find_value(param.get_obj(), "start");
+        const UniValue& end = find_value(param.get_obj(), "end");
+        if (!start.isNull())
+            nStartHeight = start.get_int();
+        if (!end.isNull())
+            nEndHeight = end.get_int();
+        if (nStartHeight < 0 || nEndHeight < 0 || (nEndHeight > 0 && nEndHeight < nStartHeight))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be an ordered range of heights");
+    }
+
+    for (size_t i = 0; i < vAddresses.size(); i++) {
+        if (!pblocktree->ReadAddressIndex(vAddresses[i].first, vAddresses[i].second, vIndex, nStartHeight, nEndHeight, view.snapshot))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+    }
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of one or more addresses (requires -addressindex).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,     (numeric) The current balance in satoshis\n"
+            "  \"hash\": \"hash\",   (string) The block hash of the tip the balance is for\n"
+            "  \"height\": n       (numeric) The block height of the tip the balance is for\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"'")
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"]}")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex and -reindex-chainstate");
+
+    // The unspent outputs add up to the balance, without going through the
+    // whole history of the addresses
+    vector<pair<int, uint160> > vAddresses = AddressesFromParam(params[0]);
+    vector<pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    CAddressIndexSnapshot view;
+    view.ReadUnspent(vAddresses, vUnspent);
+
+    CAmount nBalance = 0;
+    for (size_t i = 0; i < vUnspent.size(); i++)
+        nBalance += vUnspent[i].second.satoshis;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", nBalance));
+    view.PushChainInfo(result);
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of one or more addresses (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (string or object) An address, or an object with\n"
+            "     \"addresses\"  (array) The addresses\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"utxos\": [\n"
+            "    {\n"
+            "      \"address\": \"address\",  (string) The address\n"
+            "      \"txid\": \"hash\",        (string) The transaction id\n"
+            "      \"outputIndex\": n,        (numeric) The output index\n"
+            "      \"script\": \"hex\",       (string) The script, hex encoded\n"
+            "      \"satoshis\": n,           (numeric) The number of satoshis of the output\n"
+            "      \"height\": n              (numeric) The block height of the output\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"hash\": \"hash\",           (string) The block hash of the tip the outputs are unspent at\n"
+            "  \"height\": n                 (numeric) The block height of that tip\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"'")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"]}")
+        );
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex and -reindex-chainstate");
+
+    const UniValue& param = params[0];
+    vector<pair<int, uint160> > vAddresses = AddressesFromParam(param);
+    vector<pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    CAddressIndexSnapshot view;
+    view.ReadUnspent(vAddresses, vUnspent);
+    sort(vUnspent.begin(), vUnspent.end(), [](const pair<CAddressUnspentKey, CAddressUnspentValue>& a, const pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+        return a.second.blockHeight < b.second.blockHeight;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vUnspent.size(); i++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexToString(vUnspent[i].first.type, vUnspent[i].first.hashBytes)));
+        output.push_back(Pair("txid", vUnspent[i].first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)vUnspent[i].first.index));
+        output.push_back(Pair("script", HexStr(vUnspent[i].second.script.begin(), vUnspent[i].second.script.end())));
+        output.push_back(Pair("satoshis", vUnspent[i].second.satoshis));
+        output.push_back(Pair("height", vUnspent[i].second.blockHeight));
+        result.push_back(output);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("utxos", result));
+    view.PushChainInfo(ret);
+    return ret;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the ids of the transactions paying to or spending from one or more addresses,\n"
+            "in block order (requires -addressindex).\n"
+            "Long histories can be read in pages by passing consecutive ranges of block heights.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (string or object) An address, or an object with\n"
+            "     \"addresses\"  (array) The addresses\n"
+            "     \"start\"      (numeric, optional) The first block height to include\n"
+            "     \"end\"        (numeric, optional) The last block height to include\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txids\": [\n"
+            "    \"transactionid\"  (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"hash\": \"hash\",     (string) The block hash of the tip the history was read at\n"
+            "  \"height\": n           (numeric) The block height of that tip\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"], \"start\": 1000, \"end\": 1999}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"], \"start\": 1000, \"end\": 1999}")
+        );
+
+    const UniValue& param = params[0];
+    vector<pair<int, uint160> > vAddresses;
+    vector<pair<CAddressIndexKey, CAmount> > vIndex;
+    CAddressIndexSnapshot view;
+    ReadAddressIndexParams(param, view, vAddresses, vIndex);
+
+    // Order by position in the chain, and list each transaction once
+    vector<pair<pair<int, unsigned int>, uint256> > vTxids;
+    for (size_t i = 0; i < vIndex.size(); i++)
+        vTxids.push_back(make_pair(make_pair(vIndex[i].first.blockHeight, vIndex[i].first.txindex), vIndex[i].first.txhash));
+    sort(vTxids.begin(), vTxids.end());
+    vTxids.erase(unique(vTxids.begin(), vTxids.end()), vTxids.end());
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vTxids.size(); i++)
+        result.push_back(vTxids[i].second.GetHex());
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("txids", result));
+    view.PushChainInfo(ret);
+    return ret;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas \"address\"|{\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns every change to the balance of one or more addresses, in block order\n"
+            "(requires -addressindex).\n"
+            "Long histories can be read in pages by passing consecutive ranges of block heights.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (string or object) An address, or an object with\n"
+            "     \"addresses\"  (array) The addresses\n"
+            "     \"start\"      (numeric, optional) The first block height to include\n"
+            "     \"end\"        (numeric, optional) The last block height to include\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\": [\n"
+            "    {\n"
+            "      \"satoshis\": n,        (numeric) The difference in satoshis\n"
+            "      \"txid\": \"hash\",     (string) The transaction id\n"
+            "      \"index\": n,           (numeric) The index of the input or output\n"
+            "      \"blockindex\": n,      (numeric) The position of the transaction in its block\n"
+            "      \"height\": n,          (numeric) The block height\n"
+            "      \"address\": \"address\" (string) The address\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"hash\": \"hash\",        (string) The block hash of the tip the history was read at\n"
+            "  \"height\": n              (numeric) The block height of that tip\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"], \"start\": 1000, \"end\": 1999}'")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"CL4GESegddcYQUmc6ULtnNFYaUbSghoSnR\"], \"start\": 1000, \"end\": 1999}")
+        );
+
+    const UniValue& param = params[0];
+    vector<pair<int, uint160> > vAddresses;
+    vector<pair<CAddressIndexKey, CAmount> > vIndex;
+    CAddressIndexSnapshot view;
+    ReadAddressIndexParams(param, view, vAddresses, vIndex);
+    if (vAddresses.size() > 1) {
+        stable_sort(vIndex.begin(), vIndex.end(), [](const pair<CAddressIndexKey, CAmount>& a, const pair<CAddressIndexKey, CAmount>& b) {
+            return make_pair(a.first.blockHeight, a.first.txindex) < make_pair(b.first.blockHeight, b.first.txindex);
+        });
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("satoshis", vIndex[i].second));
+        delta.push_back(Pair("txid", vIndex[i].first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)vIndex[i].first.index));
+        delta.push_back(Pair("blockindex", (int)vIndex[i].first.txindex));
+        delta.push_back(Pair("height", vIndex[i].first.blockHeight));
+        delta.push_back(Pair("address", AddressIndexToString(vIndex[i].first.type, vIndex[i].first.hashBytes)));
+        result.push_back(delta);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("deltas", result));
+    view.PushChainInfo(ret);
+    return ret;
+}
+
+UniValue SpentInfoToJSON(const CSpentIndexValue& value)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    obj.push_back(Pair("satoshis", value.satoshis));
+    if (value.addressType != ADDRESS_INDEX_NONE)
+        obj.push_back(Pair("address", AddressIndexToString(value.addressType, value.addressHash)));
+    return obj;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the input spending an output, from the memory pool or the chain (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. \"outpoint\"   (object) The output, with\n"
+            "     \"txid\"     (string) The id of the transaction of the output\n"
+            "     \"index\"    (numeric) The output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",       (string) The id of the spending transaction\n"
+            "  \"index\": n,           (numeric) The index of the spending input\n"
+            "  \"height\": n,          (numeric) The block height of the spend, -1 if it is in the memory pool\n"
+            "  \"satoshis\": n,        (numeric) The value of the output in satoshis\n"
+            "  \"address\": \"address\"  (string, optional) The address the output paid to\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled, restart with -spentindex and -reindex-chainstate");
+
+    RPCTypeCheckObj(params[0].get_obj(),
+        {
+            {"txid", UniValueType(UniValue::VSTR)},
+            {"index", UniValueType(UniValue::VNUM)},
+        });
+    uint256 txid = ParseHashO(params[0], "txid");
+    int nOutput = find_value(params[0].get_obj(), "index").get_int();
+    if (nOutput < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, index must be positive");
+
+    CSpentIndexValue value;
+    if (!GetSpentIndex(CSpentIndexKey(txid, nOutput), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    return SpentInfoToJSON(value);
+}
+
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true  },
-    { "util",               "getcheckpoint",          &getcheckpoint,          true  },
-    { "util",               "sendcheckpoint",         &sendcheckpoint,         true  },
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
+    { "control",            "getinfo",                &getinfo,                true,       NULL,                  false }, /* uses wallet if enabled */
+    { "util",               "validateaddress",        &validateaddress,        true,       NULL,                  false }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,       NULL,                  false },
+    { "util",               "verifymessage",          &verifymessage,          true,       NULL,                  false },
+    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,       NULL,                  false },
+    { "util",               "getcheckpoint",          &getcheckpoint,          true,       NULL,                  false },
+    { "util",               "sendcheckpoint",         &sendcheckpoint,         true,       NULL,                  false },
+
+    /* Address and spent indexes */
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      true,       NULL,                  true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        true,       NULL,                  true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        true,       NULL,                  true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       true,       NULL,                  true  },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           true,       NULL,                  true  },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,       NULL,                  false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
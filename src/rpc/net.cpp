@@ -77,6 +77,27 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
     }
 }
 
+static UniValue MsgProcessTimeToJSON(const CMsgProcessTime& time)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", time.nCount));
+    obj.push_back(Pair("walltime", time.nWallMicros / 1e6));
+    obj.push_back(Pair("cputime", time.nCPUMicros / 1e6));
+    obj.push_back(Pair("lockwaittime", time.nLockWaitMicros / 1e6));
+    return obj;
+}
+
+static UniValue MsgProcessTimesToJSON(const mapMsgCmdTime& mapTimes, CMsgProcessTime& total)
+{
+    UniValue obj(UniValue::VOBJ);
+    BOOST_FOREACH(const mapMsgCmdTime::value_type &i, mapTimes) {
+        total += i.second;
+        if (i.second.nCount > 0)
+            obj.push_back(Pair(i.first, MsgProcessTimeToJSON(i.second)));
+    }
+    return obj;
+}
+
 UniValue getpeerinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -119,6 +140,16 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"processtime\": {          Time spent processing messages from this peer\n"
+            "       \"count\": n,            (numeric) The number of messages processed\n"
+            "       \"walltime\": n,         (numeric) The wall-clock time in seconds\n"
+            "       \"cputime\": n,          (numeric) The CPU time in seconds\n"
+            "       \"lockwaittime\": n      (numeric) The time in seconds spent waiting for locks held elsewhere (mostly cs_main)\n"
+            "    }\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": {...},         (object) The processing time aggregated by message type, as in processtime\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -189,6 +220,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        CMsgProcessTime processTime;
+        UniValue processTimePerMsgCmd = MsgProcessTimesToJSON(stats.mapProcessTimePerMsgCmd, processTime);
+        obj.push_back(Pair("processtime", MsgProcessTimeToJSON(processTime)));
+        obj.push_back(Pair("processtime_per_msg", processTimePerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -376,6 +412,70 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getprocessingtotals(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getprocessingtotals\n"
+            "\nReturns the time spent processing network messages, in total, by message type\n"
+            "and for each connected peer, most expensive peer first.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"total\": {                (object) Time spent processing messages since startup\n"
+            "    \"count\": n,             (numeric) The number of messages processed\n"
+            "    \"walltime\": n,          (numeric) The wall-clock time in seconds\n"
+            "    \"cputime\": n,           (numeric) The CPU time in seconds\n"
+            "    \"lockwaittime\": n       (numeric) The time in seconds spent waiting for locks held elsewhere (mostly cs_main)\n"
+            "  },\n"
+            "  \"per_msg\": {\n"
+            "    \"addr\": {...},          (object) The processing time aggregated by message type, as in total\n"
+            "    ...\n"
+            "  },\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,              (numeric) Peer index\n"
+            "      \"addr\":\"host:port\",   (string) The ip address and port of the peer\n"
+            "      \"processtime\": {...}  (object) The time spent processing messages from this peer, as in total\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getprocessingtotals", "")
+            + HelpExampleRpc("getprocessingtotals", "")
+       );
+
+    UniValue obj(UniValue::VOBJ);
+    CMsgProcessTime total;
+    UniValue perMsgCmd = MsgProcessTimesToJSON(CNode::GetTotalProcessTime(), total);
+    obj.push_back(Pair("total", MsgProcessTimeToJSON(total)));
+    obj.push_back(Pair("per_msg", perMsgCmd));
+
+    vector<CNodeStats> vstats;
+    CopyNodeStats(vstats);
+    vector<pair<CMsgProcessTime, const CNodeStats*> > vPeerTimes;
+    BOOST_FOREACH(const CNodeStats& stats, vstats) {
+        CMsgProcessTime peerTotal;
+        BOOST_FOREACH(const mapMsgCmdTime::value_type &i, stats.mapProcessTimePerMsgCmd)
+            peerTotal += i.second;
+        vPeerTimes.push_back(make_pair(peerTotal, &stats));
+    }
+    sort(vPeerTimes.begin(), vPeerTimes.end(), [](const pair<CMsgProcessTime, const CNodeStats*>& a, const pair<CMsgProcessTime, const CNodeStats*>& b) {
+        return a.first.nCPUMicros > b.first.nCPUMicros;
+    });
+
+    UniValue peers(UniValue::VARR);
+    for (size_t i = 0; i < vPeerTimes.size(); i++) {
+        UniValue peer(UniValue::VOBJ);
+        peer.push_back(Pair("id", vPeerTimes[i].second->nodeid));
+        peer.push_back(Pair("addr", vPeerTimes[i].second->addrName));
+        peer.push_back(Pair("processtime", MsgProcessTimeToJSON(vPeerTimes[i].first)));
+        peers.push_back(peer);
+    }
+    obj.push_back(Pair("peers", peers));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -572,19 +672,20 @@ UniValue clearbanned(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,       NULL,                  false },
+    { "network",            "ping",                   &ping,                   true,       NULL,                  false },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,       NULL,                  false },
+    { "network",            "addnode",                &addnode,                true,       NULL,                  false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,       NULL,                  false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,       NULL,                  false },
+    { "network",            "getnettotals",           &getnettotals,           true,       NULL,                  false },
+    { "network",            "getprocessingtotals",    &getprocessingtotals,    true,       NULL,                  false },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,       NULL,                  false },
+    { "network",            "setban",                 &setban,                 true,       NULL,                  false },
+    { "network",            "listbanned",             &listbanned,             true,       NULL,                  false },
+    { "network",            "clearbanned",            &clearbanned,            true,       NULL,                  false },
 };
 
 void RegisterNetRPCCommands(CRPCTable &tableRPC)
@@ -20,6 +20,7 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
@@ -111,6 +112,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     entry.push_back(Pair("vout", vout));
 
     if (!hashBlock.IsNull()) {
+        LOCK(cs_main);
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
@@ -196,7 +198,8 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getrawtransaction", "\"mytxid\", 1")
         );
 
-    LOCK(cs_main);
+    if (ptxindex)
+        ptxindex->BlockUntilSyncedToCurrentChain();
 
     uint256 hash = ParseHashV(params[0], "parameter 1");
 
@@ -256,6 +259,9 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
        oneTxid = hash;
     }
 
+    if (ptxindex)
+        ptxindex->BlockUntilSyncedToCurrentChain();
+
     LOCK(cs_main);
 
     CBlockIndex* pblockindex = NULL;
@@ -905,17 +911,17 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
-
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,       NULL,                  true  },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,       NULL,                  false },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,       NULL,                  true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,       NULL,                  true  },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false,      NULL,                  false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false,      NULL,                  false }, /* uses wallet if enabled */
+
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,       NULL,                  false },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,       NULL,                  false },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &tableRPC)
@@ -8,6 +8,8 @@
 #include "base58.h"
 #include "init.h"
 #include "random.h"
+#include "rpc/jsonstream.h"
+#include "scheduler.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -37,6 +39,11 @@ static RPCTimerInterface* timerInterface = NULL;
 /* Map of name to timer.
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
+/* Threads running the entries of JSON-RPC batches, if -rpcbatchthreads is set */
+static CCriticalSection cs_rpcBatch;
+static CScheduler* rpcBatchScheduler = NULL;
+static int nRPCBatchThreads = 0;
+static boost::thread_group rpcBatchThreads;
 
 static struct CRPCSignals
 {
@@ -266,11 +273,11 @@ UniValue stop(const UniValue& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  streamActor            okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------------  ----------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "help",                   &help,                   true,       NULL,                  false },
+    { "control",            "stop",                   &stop,                   true,       NULL,                  false },
 };
 
 CRPCTable::CRPCTable()
@@ -310,6 +317,16 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
+    int nBatchThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 0);
+    if (nBatchThreads > 0) {
+        LogPrint("rpc", "Starting %d RPC batch threads\n", nBatchThreads);
+        LOCK(cs_rpcBatch);
+        rpcBatchScheduler = new CScheduler();
+        nRPCBatchThreads = nBatchThreads;
+        CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, rpcBatchScheduler);
+        for (int i = 0; i < nBatchThreads; i++)
+            rpcBatchThreads.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "rpcbatch", serviceLoop));
+    }
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -326,6 +343,19 @@ void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
     deadlineTimers.clear();
+    // Batches still being executed finish on the threads serving them
+    CScheduler* scheduler;
+    {
+        LOCK(cs_rpcBatch);
+        scheduler = rpcBatchScheduler;
+        rpcBatchScheduler = NULL;
+        nRPCBatchThreads = 0;
+    }
+    if (scheduler) {
+        scheduler->stop(false);
+        rpcBatchThreads.join_all();
+        delete scheduler;
+    }
     g_rpcSignals.Stopped();
 }
 
@@ -409,13 +439,88 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Whether a batch entry calls a method that may run alongside other entries */
+static bool IsParallelRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req, "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->okParallel;
+}
+
+/**
+ * Consecutive entries of a batch that are executed in parallel. The thread
+ * serving the batch and the batch threads helping it take the next entry
+ * until none are left, so the entries are executed even if no batch thread
+ * gets to run.
+ */
+struct CRPCBatchRun
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    const UniValue& vReq;
+    size_t nBegin;
+    std::vector<UniValue> vReply;
+    size_t nNext; //!< next entry to execute, counted from nBegin
+    size_t nDone;
+
+    CRPCBatchRun(const UniValue& vReqIn, size_t nBeginIn, size_t nEnd) :
+        vReq(vReqIn), nBegin(nBeginIn), vReply(nEnd - nBeginIn), nNext(0), nDone(0) {}
+};
+
+static void JSONRPCExecBatchRun(boost::shared_ptr<CRPCBatchRun> run)
+{
+    boost::unique_lock<boost::mutex> lock(run->cs);
+    while (run->nNext < run->vReply.size()) {
+        size_t i = run->nNext++;
+        lock.unlock();
+        UniValue reply = JSONRPCExecOne(run->vReq[run->nBegin + i]);
+        lock.lock();
+        run->vReply[i] = reply;
+        if (++run->nDone == run->vReply.size())
+            run->cond.notify_all();
+    }
+}
+
+void JSONRPCExecBatch(const UniValue& vReq, CJSONStreamWriter& writer)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    writer.BeginArray();
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelRequest(vReq[nEnd]))
+            nEnd++;
 
-    return ret.write() + "\n";
+        if (nEnd - reqIdx < 2) {
+            writer.Value(JSONRPCExecOne(vReq[reqIdx]));
+            reqIdx++;
+            continue;
+        }
+
+        boost::shared_ptr<CRPCBatchRun> run(new CRPCBatchRun(vReq, reqIdx, nEnd));
+        {
+            LOCK(cs_rpcBatch);
+            if (rpcBatchScheduler) {
+                size_t nHelpers = std::min((size_t)nRPCBatchThreads, nEnd - reqIdx - 1);
+                for (size_t i = 0; i < nHelpers; i++)
+                    rpcBatchScheduler->schedule(boost::bind(&JSONRPCExecBatchRun, run), boost::chrono::system_clock::now());
+            }
+        }
+        JSONRPCExecBatchRun(run);
+        {
+            boost::unique_lock<boost::mutex> lock(run->cs);
+            while (run->nDone < run->vReply.size())
+                run->cond.wait(lock);
+        }
+
+        BOOST_FOREACH(const UniValue& reply, run->vReply)
+            writer.Value(reply);
+        reqIdx = nEnd;
+    }
+    writer.EndArray();
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
@@ -447,6 +552,37 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+void CRPCTable::execute(const std::string &strMethod, const UniValue &params, CJSONStreamWriter& writer) const
+{
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd || !pcmd->streamActor) {
+        writer.Value(execute(strMethod, params));
+        return;
+    }
+
+    // Return immediately if in warmup
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
+    }
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        // Execute
+        if (!pcmd->streamActor(params, writer))
+            writer.Value(pcmd->actor(params, false));
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
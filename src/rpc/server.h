@@ -20,6 +20,8 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Threads executing the read-only entries of JSON-RPC batches in parallel */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
 
 class CRPCCommand;
 
@@ -32,6 +34,7 @@ namespace RPCServer
 }
 
 class CBlockIndex;
+class CJSONStreamWriter;
 class CNetAddr;
 
 /** Wrapper for UniValue::VType, which includes typeAny:
@@ -126,6 +129,13 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/**
+ * Version of an RPC call that writes its result to a stream as it is built,
+ * for calls with large results. It produces the same JSON as the actor, and
+ * returns false without writing anything for arguments it leaves to the actor.
+ */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStreamWriter& writer);
+
 class CRPCCommand
 {
 public:
@@ -133,6 +143,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    rpcstreamfn_type streamActor; //!< optional, NULL if the result is only returned by actor
+    bool okParallel; //!< read-only, so entries of a batch calling it may run at the same time
 };
 
 /**
@@ -156,6 +168,13 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing the result to a stream. Methods with a
+     * streaming actor write their result as it is built.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    void execute(const std::string &method, const UniValue &params, CJSONStreamWriter& writer) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -195,7 +214,13 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/**
+ * Execute a JSON-RPC batch, writing the replies in the order of the requests.
+ * Consecutive requests for calls marked okParallel are spread over the batch
+ * threads (-rpcbatchthreads); any other request runs by itself once the ones
+ * before it are done.
+ */
+void JSONRPCExecBatch(const UniValue& vReq, CJSONStreamWriter& writer);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -5,29 +5,19 @@
 
 #include "sigcache.h"
 
-#include "memusage.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
+#include "cuckoocache.h"
+
+#include <atomic>
+
 #include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
 
 namespace {
 
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- */
-class CSignatureCacheHasher
-{
-public:
-    size_t operator()(const uint256& key) const {
-        return key.GetCheapHash();
-    }
-};
-
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -38,13 +28,18 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
+    //! Lookups and erasure only need the shared lock; erasure is a lock-free flag update.
     boost::shared_mutex cs_sigcache;
 
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    size_t nMaxEntries;
 
 public:
-    CSignatureCache()
+    CSignatureCache() : nHits(0), nMisses(0), nInserts(0), nMaxEntries(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -56,58 +51,81 @@ public:
     }
 
     bool
-    Get(const uint256& entry)
+    Get(const uint256& entry, const bool erase)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        bool fFound = setValid.contains(entry, erase);
+        if (fFound)
+            nHits.fetch_add(1, std::memory_order_relaxed);
+        else
+            nMisses.fetch_add(1, std::memory_order_relaxed);
+        return fFound;
     }
 
-    void Erase(const uint256& entry)
+    void Set(const uint256& entry)
     {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        setValid.insert(entry);
+        nInserts.fetch_add(1, std::memory_order_relaxed);
     }
 
-    void Set(const uint256& entry)
+    uint32_t setup_bytes(size_t n)
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-        if (nMaxCacheSize <= 0) return;
-
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
-            }
-        }
+        nMaxEntries = setValid.setup_bytes(n);
+        return nMaxEntries;
+    }
 
-        setValid.insert(entry);
+    void GetStats(ValidationCacheStats& stats)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        stats.nMaxEntries = nMaxEntries;
+        stats.nBytes = setValid.MemoryUsage();
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        stats.nInserts = nInserts.load(std::memory_order_relaxed);
     }
 };
 
+/* In previous versions of this code, signatureCache was a local static variable
+ * in CachingTransactionSignatureChecker::VerifySignature. It is now a
+ * file-scope static so that it can be sized once by InitSignatureCache()
+ * before any script verification threads are started.
+ */
+static CSignatureCache signatureCache;
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+// To be called once in AppInit2/TestingSetup to initialize the signatureCache
+void InitSignatureCache()
 {
-    static CSignatureCache signatureCache;
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    // The limit is shared with the script execution cache.
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
 
+ValidationCacheStats GetValidationCacheStats()
+{
+    ValidationCacheStats stats;
+    signatureCache.GetStats(stats);
+    return stats;
+}
+
+bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(entry)) {
-        if (!store) {
-            signatureCache.Erase(entry);
-        }
+    if (signatureCache.Get(entry, !store))
         return true;
-    }
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
-    if (store) {
+    if (store)
         signatureCache.Set(entry);
-    }
     return true;
 }
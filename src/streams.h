@@ -15,6 +15,7 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <string>
@@ -332,6 +333,12 @@ public:
         clear();
     }
 
+    /** Exchange the underlying buffer with data and rewind, without copying. */
+    void swap(CSerializeData &data) {
+        vch.swap(data);
+        nReadPos = 0;
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
@@ -365,6 +372,92 @@ public:
 
 
 
+/** Reads a stream of bits, most significant bit first, from a byte stream */
+template <typename IStream>
+class BitStreamReader
+{
+private:
+    IStream& istream;
+
+    /** Byte last read from the stream; a new one is read once all its bits are used */
+    uint8_t nBuffer;
+
+    /** Number of high order bits of nBuffer already returned */
+    int nOffset;
+
+public:
+    explicit BitStreamReader(IStream& istreamIn) : istream(istreamIn), nBuffer(0), nOffset(8) {}
+
+    /** Read the next nbits bits (at most 64) as an integer, first bit most significant */
+    uint64_t Read(int nbits) {
+        if (nbits < 0 || nbits > 64)
+            throw std::out_of_range("nbits must be between 0 and 64");
+
+        uint64_t data = 0;
+        while (nbits > 0) {
+            if (nOffset == 8) {
+                nBuffer = ser_readdata8(istream);
+                nOffset = 0;
+            }
+
+            int bits = std::min(8 - nOffset, nbits);
+            data <<= bits;
+            data |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - bits);
+            nOffset += bits;
+            nbits -= bits;
+        }
+        return data;
+    }
+};
+
+/** Writes a stream of bits, most significant bit first, to a byte stream */
+template <typename OStream>
+class BitStreamWriter
+{
+private:
+    OStream& ostream;
+
+    /** Byte being filled; it is written to the stream once full */
+    uint8_t nBuffer;
+
+    /** Number of high order bits of nBuffer already written */
+    int nOffset;
+
+public:
+    explicit BitStreamWriter(OStream& ostreamIn) : ostream(ostreamIn), nBuffer(0), nOffset(0) {}
+
+    ~BitStreamWriter()
+    {
+        Flush();
+    }
+
+    /** Write the nbits (at most 64) low order bits of data, most significant first */
+    void Write(uint64_t data, int nbits) {
+        if (nbits < 0 || nbits > 64)
+            throw std::out_of_range("nbits must be between 0 and 64");
+
+        while (nbits > 0) {
+            int bits = std::min(8 - nOffset, nbits);
+            nBuffer |= (data << (64 - nbits)) >> (64 - 8 + nOffset);
+            nOffset += bits;
+            nbits -= bits;
+
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    /** Write out the byte being filled, padded with zero bits */
+    void Flush() {
+        if (nOffset == 0)
+            return;
+
+        ser_writedata8(ostream, nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
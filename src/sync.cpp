@@ -20,6 +20,20 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static boost::thread_specific_ptr<int64_t> nThreadLockWaitMicros;
+
+void AddThreadLockWaitMicros(int64_t nMicros)
+{
+    if (!nThreadLockWaitMicros.get())
+        nThreadLockWaitMicros.reset(new int64_t(0));
+    *nThreadLockWaitMicros += nMicros;
+}
+
+int64_t GetThreadLockWaitMicros()
+{
+    return nThreadLockWaitMicros.get() ? *nThreadLockWaitMicros : 0;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -7,6 +7,7 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -108,6 +109,11 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Add to the time the current thread has spent blocked on contended locks */
+void AddThreadLockWaitMicros(int64_t nMicros);
+/** Total time in microseconds the current thread has spent blocked on contended locks */
+int64_t GetThreadLockWaitMicros();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -118,14 +124,14 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            int64_t nWaitStart = GetTimeMicros();
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            AddThreadLockWaitMicros(GetTimeMicros() - nWaitStart);
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -0,0 +1,291 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "base58.h"
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "main.h"
+#include "rpc/server.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+extern UniValue CallRPC(std::string args);
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_hash)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    int type;
+    uint160 hashBytes;
+
+    BOOST_CHECK(GetAddressIndexHash(GetScriptForDestination(pubkey.GetID()), type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    // Paying to the key itself counts for its address
+    BOOST_CHECK(GetAddressIndexHash(CScript() << ToByteVector(pubkey) << OP_CHECKSIG, type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    CScript redeemScript = CScript() << OP_1;
+    BOOST_CHECK(GetAddressIndexHash(GetScriptForDestination(CScriptID(redeemScript)), type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_SCRIPTHASH);
+    BOOST_CHECK(hashBytes == CScriptID(redeemScript));
+
+    BOOST_CHECK(!GetAddressIndexHash(CScript() << OP_RETURN, type, hashBytes));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_db)
+{
+    uint160 hashA = uint160(ParseHex("0101010101010101010101010101010101010101"));
+    uint160 hashB = uint160(ParseHex("0101010101010101010101010101010101010102"));
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+
+    // Entries are kept in block order, whatever the order they are written in
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 300, 1, txid2, 0, true), -50));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 2, 0, txid1, 0, false), 50));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashA, 256, 3, txid2, 1, false), 20));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPTHASH, hashA, 5, 0, txid1, 1, false), 7));
+    vIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashB, 5, 0, txid1, 2, false), 8));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, txid1, 0), CAddressUnspentValue(50, CScript() << OP_1, 2)));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, txid1, 0), CAddressUnspentValue()));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, txid2, 1), CAddressUnspentValue(20, CScript() << OP_2, 256)));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vIndex, vUnspent));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 3U);
+    BOOST_CHECK_EQUAL(vRead[0].first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vRead[1].first.blockHeight, 256);
+    BOOST_CHECK_EQUAL(vRead[2].first.blockHeight, 300);
+    BOOST_CHECK(vRead[2].first.txhash == txid2);
+    BOOST_CHECK(vRead[2].first.spending);
+    BOOST_CHECK_EQUAL(vRead[2].second, -50);
+
+    // Height ranges
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead, 3, 299));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vRead[0].first.blockHeight, 256);
+
+    // Only the output that was not spent again is unspent
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentRead;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vUnspentRead));
+    BOOST_REQUIRE_EQUAL(vUnspentRead.size(), 1U);
+    BOOST_CHECK(vUnspentRead[0].first.txhash == txid2);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].second.satoshis, 20);
+    BOOST_CHECK(vUnspentRead[0].second.script == CScript() << OP_2);
+    BOOST_CHECK_EQUAL(vUnspentRead[0].second.blockHeight, 256);
+
+    // Erasing restores the earlier state
+    vUnspent.clear();
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, txid2, 1), CAddressUnspentValue()));
+    vUnspent.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hashA, txid1, 0), CAddressUnspentValue(50, CScript() << OP_1, 2)));
+    BOOST_CHECK(pblocktree->EraseAddressIndex(std::vector<std::pair<CAddressIndexKey, CAmount> >(vIndex.begin(), vIndex.begin() + 1), vUnspent));
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    vUnspentRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, hashA, vUnspentRead));
+    BOOST_REQUIRE_EQUAL(vUnspentRead.size(), 1U);
+    BOOST_CHECK(vUnspentRead[0].first.txhash == txid1);
+
+    vUnspentRead.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_SCRIPTHASH, hashA, vUnspentRead));
+    BOOST_CHECK(vUnspentRead.empty());
+}
+
+BOOST_AUTO_TEST_CASE(spentindex_db)
+{
+    uint160 hashA = uint160(ParseHex("0101010101010101010101010101010101010101"));
+    uint256 txidPrev = GetRandHash(), txidSpend = GetRandHash();
+    CSpentIndexKey key(txidPrev, 1);
+    CSpentIndexValue value;
+
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(key, value));
+
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(key, CSpentIndexValue(txidSpend, 2, 150, 1000, ADDRESS_INDEX_PUBKEYHASH, hashA)));
+    BOOST_CHECK(pblocktree->UpdateSpentIndex(vSpent));
+
+    BOOST_CHECK(pblocktree->ReadSpentIndex(key, value));
+    BOOST_CHECK(value.txid == txidSpend);
+    BOOST_CHECK_EQUAL(value.inputIndex, 2U);
+    BOOST_CHECK_EQUAL(value.blockHeight, 150);
+    BOOST_CHECK_EQUAL(value.satoshis, 1000);
+    BOOST_CHECK_EQUAL(value.addressType, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(value.addressHash == hashA);
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(CSpentIndexKey(txidPrev, 0), value));
+
+    // A null value erases the entry
+    vSpent[0].second.SetNull();
+    BOOST_CHECK(pblocktree->UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(key, value));
+}
+
+static CMutableTransaction SpendOutput(const CTransaction& txPrev, unsigned int n, const CKey& key, const CScript& scriptPubKeyPrev,
+                                       const CScript& scriptPubKey, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKeyPrev, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    if (scriptPubKeyPrev == GetScriptForDestination(key.GetPubKey().GetID()))
+        tx.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+    else
+        tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_chain, TestChain100Setup)
+{
+    CKey keyA, keyB;
+    keyA.MakeNewKey(true);
+    keyB.MakeNewKey(true);
+    CScript scriptA = GetScriptForDestination(keyA.GetPubKey().GetID());
+    CScript scriptB = GetScriptForDestination(keyB.GetPubKey().GetID());
+    std::string strA = CBitcoinAddress(keyA.GetPubKey().GetID()).ToString();
+    std::string strB = CBitcoinAddress(keyB.GetPubKey().GetID()).ToString();
+    CScript scriptCoinbase = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Coinbases take COINBASE_MATURITY_FORKONE blocks to mature on regtest
+    while (chainActive.Height() < COINBASE_MATURITY_FORKONE)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptCoinbase);
+
+    // Only the blocks connected from here on are indexed
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    // The output paying A is created and spent again in the same block
+    std::vector<CMutableTransaction> txns;
+    txns.push_back(SpendOutput(coinbaseTxns[0], 0, coinbaseKey, scriptCoinbase, scriptA, 11 * CENT));
+    txns.push_back(SpendOutput(txns[0], 0, keyA, scriptA, scriptB, 10 * CENT));
+    uint256 txid1 = txns[0].GetHash(), txid2 = txns[1].GetHash();
+
+    CBlock block = CreateAndProcessBlock(txns, scriptCoinbase);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    int nHeight = chainActive.Height();
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, keyA.GetPubKey().GetID(), vIndex));
+    BOOST_REQUIRE_EQUAL(vIndex.size(), 2U);
+    BOOST_CHECK(vIndex[0].first.txhash == txid1);
+    BOOST_CHECK(!vIndex[0].first.spending);
+    BOOST_CHECK_EQUAL(vIndex[0].first.blockHeight, nHeight);
+    BOOST_CHECK_EQUAL(vIndex[0].second, 11 * CENT);
+    BOOST_CHECK(vIndex[1].first.txhash == txid2);
+    BOOST_CHECK(vIndex[1].first.spending);
+    BOOST_CHECK_EQUAL(vIndex[1].second, -11 * CENT);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, keyA.GetPubKey().GetID(), vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, keyB.GetPubKey().GetID(), vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == txid2);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.satoshis, 10 * CENT);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.blockHeight, nHeight);
+
+    CSpentIndexValue value;
+    BOOST_CHECK(pblocktree->ReadSpentIndex(CSpentIndexKey(txid1, 0), value));
+    BOOST_CHECK(value.txid == txid2);
+    BOOST_CHECK_EQUAL(value.blockHeight, nHeight);
+    BOOST_CHECK_EQUAL(value.satoshis, 11 * CENT);
+    BOOST_CHECK(value.addressHash == keyA.GetPubKey().GetID());
+    BOOST_CHECK(pblocktree->ReadSpentIndex(CSpentIndexKey(coinbaseTxns[0].GetHash(), 0), value));
+    BOOST_CHECK(value.txid == txid1);
+
+    // The RPC calls read the same entries
+    UniValue r = CallRPC("getaddressbalance \"" + strB + "\"");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "balance").get_int64(), 10 * CENT);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "height").get_int(), nHeight);
+    r = CallRPC("getaddressbalance \"" + strA + "\"");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "balance").get_int64(), 0);
+
+    r = CallRPC("getaddressutxos {\"addresses\":[\"" + strA + "\",\"" + strB + "\"]}");
+    UniValue utxos = find_value(r.get_obj(), "utxos");
+    BOOST_REQUIRE_EQUAL(utxos.size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(utxos[0].get_obj(), "txid").get_str(), txid2.GetHex());
+    BOOST_CHECK_EQUAL(find_value(utxos[0].get_obj(), "height").get_int(), nHeight);
+
+    r = CallRPC("getaddressdeltas \"" + strA + "\"");
+    UniValue deltas = find_value(r.get_obj(), "deltas");
+    BOOST_REQUIRE_EQUAL(deltas.size(), 2U);
+    BOOST_CHECK_EQUAL(find_value(deltas[1].get_obj(), "satoshis").get_int64(), -11 * CENT);
+
+    r = CallRPC("getaddresstxids {\"addresses\":[\"" + strA + "\"],\"start\":" + itostr(nHeight) + "}");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "txids").size(), 2U);
+
+    r = CallRPC("getspentinfo {\"txid\":\"" + txid1.GetHex() + "\",\"index\":0}");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "txid").get_str(), txid2.GetHex());
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "height").get_int(), nHeight);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "address").get_str(), strA);
+
+    // Disconnecting the block removes its entries again
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight - 1);
+
+    vIndex.clear();
+    BOOST_CHECK(pblocktree->ReadAddressIndex(ADDRESS_INDEX_PUBKEYHASH, keyA.GetPubKey().GetID(), vIndex));
+    BOOST_CHECK(vIndex.empty());
+    vUnspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(ADDRESS_INDEX_PUBKEYHASH, keyB.GetPubKey().GetID(), vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(CSpentIndexKey(txid1, 0), value));
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(CSpentIndexKey(coinbaseTxns[0].GetHash(), 0), value));
+
+    // The disconnected transactions went back to the memory pool, which is
+    // looked at before the index
+    BOOST_CHECK(mempool.exists(txid1) && mempool.exists(txid2));
+    BOOST_CHECK(GetSpentIndex(CSpentIndexKey(txid1, 0), value));
+    BOOST_CHECK(value.txid == txid2);
+    BOOST_CHECK_EQUAL(value.blockHeight, -1);
+    BOOST_CHECK_EQUAL(value.satoshis, 11 * CENT);
+    BOOST_CHECK(GetSpentIndex(CSpentIndexKey(coinbaseTxns[0].GetHash(), 0), value));
+    BOOST_CHECK(value.txid == txid1);
+    BOOST_CHECK_EQUAL(value.blockHeight, -1);
+    BOOST_CHECK_EQUAL(value.satoshis, coinbaseTxns[0].vout[0].nValue);
+    BOOST_CHECK(value.addressHash == coinbaseKey.GetPubKey().GetID());
+
+    r = CallRPC("getaddressbalance \"" + strB + "\"");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "balance").get_int64(), 0);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "height").get_int(), nHeight - 1);
+    r = CallRPC("getspentinfo {\"txid\":\"" + txid1.GetHex() + "\",\"index\":0}");
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "height").get_int(), -1);
+
+    mempool.clear();
+    fAddressIndex = false;
+    fSpentIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,234 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "blockfilterindex.h"
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(element1);
+
+        // Never all zero, which is the first included element
+        GCSFilter::Element element2(32);
+        element2[1] = i + 1;
+        excluded_elements.insert(element2);
+    }
+
+    GCSFilter filter(0, 0, 10, 1 << 10, included_elements);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    BOOST_FOREACH(const GCSFilter::Element& element, included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet single;
+        single.insert(element);
+        BOOST_CHECK(filter.MatchAny(single));
+    }
+    BOOST_CHECK(filter.MatchAny(included_elements));
+
+    // With a false positive rate of 2^-10, none of the excluded elements are
+    // expected to match
+    BOOST_CHECK(!filter.MatchAny(excluded_elements));
+    BOOST_CHECK(!filter.MatchAny(GCSFilter::ElementSet()));
+
+    // A filter decoded from the encoding matches the same elements
+    GCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    BOOST_CHECK(decoded.MatchAny(included_elements));
+    BOOST_CHECK(!decoded.MatchAny(excluded_elements));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_empty_and_malformed)
+{
+    GCSFilter empty(0, 0, 10, 1 << 10);
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK_EQUAL(empty.GetEncoded().size(), 1U);
+    BOOST_CHECK(!empty.Match(GCSFilter::Element(32)));
+
+    GCSFilter built(0, 0, 10, 1 << 10, GCSFilter::ElementSet());
+    BOOST_CHECK(built.GetEncoded() == empty.GetEncoded());
+
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10; ++i)
+        elements.insert(GCSFilter::Element(1, i));
+    std::vector<unsigned char> vEncoded = GCSFilter(0, 0, 10, 1 << 10, elements).GetEncoded();
+
+    // Truncated data or trailing bytes are rejected
+    std::vector<unsigned char> vTruncated(vEncoded.begin(), vEncoded.end() - 1);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, vTruncated), std::ios_base::failure);
+    std::vector<unsigned char> vExtended(vEncoded);
+    vExtended.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, vExtended), std::ios_base::failure);
+    BOOST_CHECK_THROW(GCSFilter(0, 0, 10, 1 << 10, std::vector<unsigned char>()), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // First two are outputs on a single transaction
+    included_scripts[0] << std::vector<unsigned char>(65, 0) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // Third is an output on a second transaction
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(33, 2) << OP_1 << OP_CHECKMULTISIG;
+
+    // Last two are spent by a single transaction
+    included_scripts[3] << OP_0 << std::vector<unsigned char>(32, 3);
+    included_scripts[4] << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+
+    // OP_RETURN output, an empty output script and an unrelated script
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(40, 4);
+    excluded_scripts[2] << OP_2 << OP_ADD << OP_5 << OP_EQUAL;
+
+    CMutableTransaction tx_1;
+    tx_1.vout.resize(2);
+    tx_1.vout[0].scriptPubKey = included_scripts[0];
+    tx_1.vout[1].scriptPubKey = included_scripts[1];
+
+    CMutableTransaction tx_2;
+    tx_2.vout.resize(3);
+    tx_2.vout[0].scriptPubKey = included_scripts[2];
+    tx_2.vout[1].scriptPubKey = excluded_scripts[0];
+    tx_2.vout[2].scriptPubKey = excluded_scripts[1];
+
+    CBlock block;
+    block.vtx.push_back(tx_1);
+    block.vtx.push_back(tx_2);
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.push_back(CTxUndo());
+    block_undo.vtxundo.back().vprevout.push_back(CTxInUndo(CTxOut(100, included_scripts[3])));
+    block_undo.vtxundo.back().vprevout.push_back(CTxInUndo(CTxOut(100, included_scripts[4])));
+    block_undo.vtxundo.back().vprevout.push_back(CTxInUndo(CTxOut(100, excluded_scripts[1])));
+
+    BlockFilter block_filter(BLOCK_FILTER_BASIC, block, block_undo);
+    BOOST_CHECK(block_filter.GetBlockHash() == block.GetHash());
+    const GCSFilter& filter = block_filter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 5U);
+
+    for (int i = 0; i < 5; ++i)
+        BOOST_CHECK(filter.Match(GCSFilter::Element(included_scripts[i].begin(), included_scripts[i].end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_scripts[0].begin(), excluded_scripts[0].end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded_scripts[2].begin(), excluded_scripts[2].end())));
+
+    // Serialization round trip
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    BlockFilter block_filter2;
+    stream >> block_filter2;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK_EQUAL(block_filter2.GetFilterType(), BLOCK_FILTER_BASIC);
+    BOOST_CHECK(block_filter2.GetBlockHash() == block_filter.GetBlockHash());
+    BOOST_CHECK(block_filter2.GetEncodedFilter() == block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter2.GetHash() == block_filter.GetHash());
+
+    // The filter is keyed by the block hash
+    BlockFilter block_filter3(BLOCK_FILTER_BASIC, block.GetHash(), block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter3.GetFilter().Match(GCSFilter::Element(included_scripts[0].begin(), included_scripts[0].end())));
+
+    // Headers commit to the previous header
+    uint256 prevHeader = GetRandHash();
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) == block_filter2.ComputeHeader(prevHeader));
+    BOOST_CHECK(block_filter.ComputeHeader(prevHeader) != block_filter.ComputeHeader(uint256()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_reference_vector)
+{
+    // The testnet3 genesis block from BIP 158's reference test vectors
+    // (blockfilters.json). Blocks here are hashed with X11, so the filter is
+    // built from the vector's SHA256d block hash and the block's output script
+    // rather than from a CBlock.
+    uint256 hashBlock = uint256S("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    std::vector<unsigned char> script = ParseHex("4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac");
+    GCSFilter::ElementSet elements;
+    elements.insert(GCSFilter::Element(script.begin(), script.end()));
+
+    GCSFilter filter(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8), BASIC_FILTER_P, BASIC_FILTER_M, elements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+
+    BlockFilter block_filter(BLOCK_FILTER_BASIC, hashBlock, filter.GetEncoded());
+    BOOST_CHECK(block_filter.GetFilter().Match(GCSFilter::Element(script.begin(), script.end())));
+    BOOST_CHECK_EQUAL(block_filter.ComputeHeader(uint256()).GetHex(), "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750");
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BlockFilterType filterType;
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BLOCK_FILTER_BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BLOCK_FILTER_INVALID), "");
+    BOOST_CHECK(BlockFilterTypeByName("basic", filterType));
+    BOOST_CHECK_EQUAL(filterType, BLOCK_FILTER_BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filterType));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_initial_sync, TestChain100Setup)
+{
+    CBlockFilterIndex filter_index(BLOCK_FILTER_BASIC, 1 << 20, true);
+    BlockFilter filter;
+    uint256 header;
+
+    BOOST_CHECK(!filter_index.LookupFilter(chainActive.Genesis(), filter));
+    StartIndexSync(filter_index);
+
+    // Every block has a filter matching its recomputed one, and headers chain
+    uint256 prevHeader;
+    for (int nHeight = 0; nHeight <= chainActive.Height(); nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        BOOST_REQUIRE(filter_index.LookupFilter(pindex, filter));
+        BOOST_REQUIRE(filter_index.LookupFilterHeader(pindex, header));
+
+        CBlock block;
+        CBlockUndo block_undo;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+        if (nHeight > 0)
+            BOOST_REQUIRE(UndoReadFromDisk(block_undo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()));
+        BlockFilter expected(BLOCK_FILTER_BASIC, block, block_undo);
+        BOOST_CHECK(filter.GetEncodedFilter() == expected.GetEncodedFilter());
+        BOOST_CHECK(header == expected.ComputeHeader(prevHeader));
+        prevHeader = header;
+    }
+
+    // Range lookups return the same filters
+    std::vector<BlockFilter> vFilters;
+    std::vector<uint256> vHashes;
+    BOOST_CHECK(filter_index.LookupFilterRange(10, chainActive[20], vFilters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(10, chainActive[20], vHashes));
+    BOOST_REQUIRE_EQUAL(vFilters.size(), 11U);
+    BOOST_REQUIRE_EQUAL(vHashes.size(), 11U);
+    for (int i = 0; i < 11; i++) {
+        BOOST_CHECK(vFilters[i].GetBlockHash() == chainActive[10 + i]->GetBlockHash());
+        BOOST_CHECK(vHashes[i] == vFilters[i].GetHash());
+    }
+    BOOST_CHECK(!filter_index.LookupFilterRange(21, chainActive[20], vFilters));
+
+    // The filter of a new block holds its coinbase output script
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    CBlock block = CreateAndIndexBlock(filter_index, scriptPubKey);
+    BOOST_REQUIRE(filter_index.LookupFilter(chainActive.Tip(), filter));
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK(filter.GetFilter().Match(GCSFilter::Element(scriptPubKey.begin(), scriptPubKey.end())));
+
+    StopIndexSync();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+/** Test Suite for CuckooCache
+ *
+ *  1) All tests should have a deterministic result (using insecure rand
+ *  with deterministic seeds)
+ *  2) Some test methods are templated to allow for easier testing
+ *  against new versions / comparing
+ *  3) Results should be treated as a regression test, i.e., did the behavior
+ *  change significantly from what was expected. This can be OK, depending on
+ *  the nature of the change, but requires updating the tests to reflect the new
+ *  expected behavior. For example improving the hit rate may cause some tests
+ *  using BOOST_CHECK_CLOSE to fail.
+ */
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+static void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Fill a vector of n random hashes, deterministically */
+static std::vector<uint256> RandomHashes(size_t n)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> hashes(n);
+    for (size_t i = 0; i < n; ++i)
+        insecure_GetRandHash(hashes[i]);
+    return hashes;
+}
+
+/** Fraction of hashes that are still found after inserting them all */
+static double HitRate(const CuckooCache::cache<uint256, SignatureCacheHasher>& set, const std::vector<uint256>& hashes)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < hashes.size(); ++i)
+        count += set.contains(hashes[i], false);
+    return double(count) / double(hashes.size());
+}
+
+/* Test that no values not inserted into the cache are read out of it.
+ *
+ * There are no repeats in the first 200000 insecure_GetRandHash calls
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_no_fakes)
+{
+    std::vector<uint256> hashes = RandomHashes(200000);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc;
+    cc.setup_bytes(32 << 20);
+    for (size_t i = 0; i < 100000; ++i)
+        cc.insert(hashes[i]);
+    for (size_t i = 100000; i < hashes.size(); ++i)
+        BOOST_CHECK(!cc.contains(hashes[i], false));
+}
+
+/* Check the hit rate when a cache of n entries is filled with fractions of n */
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
+{
+    const size_t megabytes = 4;
+    CuckooCache::cache<uint256, SignatureCacheHasher> set;
+    uint32_t n_insert = set.setup_bytes(megabytes << 20);
+    BOOST_CHECK_EQUAL(n_insert, (megabytes << 20) / sizeof(uint256));
+    BOOST_CHECK(set.MemoryUsage() >= n_insert * sizeof(uint256));
+
+    // Half full: everything must still be there.
+    std::vector<uint256> hashes = RandomHashes(n_insert / 2);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        set.insert(hashes[i]);
+    BOOST_CHECK(HitRate(set, hashes) > 0.99);
+
+    // Twice the capacity: at least the more recent half is expected to survive.
+    CuckooCache::cache<uint256, SignatureCacheHasher> full;
+    full.setup_bytes(megabytes << 20);
+    hashes = RandomHashes(n_insert * 2);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        full.insert(hashes[i]);
+    std::vector<uint256> recent(hashes.end() - n_insert / 4, hashes.end());
+    BOOST_CHECK(HitRate(full, recent) > 0.95);
+}
+
+/* Entries flagged for erasure are found until a later insert reuses their
+ * slot, and are the first to go when the cache fills up.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
+{
+    const size_t megabytes = 4;
+    CuckooCache::cache<uint256, SignatureCacheHasher> set;
+    uint32_t n_insert = set.setup_bytes(megabytes << 20);
+    std::vector<uint256> hashes = RandomHashes(n_insert);
+
+    // Fill half of the table and erase the first half of that.
+    for (uint32_t i = 0; i < n_insert / 2; ++i)
+        set.insert(hashes[i]);
+    for (uint32_t i = 0; i < n_insert / 4; ++i)
+        BOOST_CHECK(set.contains(hashes[i], true));
+    // Erasure is lazy, so everything is still readable.
+    std::vector<uint256> erased(hashes.begin(), hashes.begin() + n_insert / 4);
+    std::vector<uint256> kept(hashes.begin() + n_insert / 4, hashes.begin() + n_insert / 2);
+    BOOST_CHECK(HitRate(set, erased) > 0.99);
+
+    // Insert another quarter; erased slots are reused before live ones are
+    // evicted, and the live entries are still within the last two epochs.
+    for (uint32_t i = n_insert / 2; i < (3 * n_insert) / 4; ++i)
+        set.insert(hashes[i]);
+    BOOST_CHECK(HitRate(set, kept) > 0.95);
+    BOOST_CHECK(HitRate(set, erased) < HitRate(set, kept));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 
@@ -126,6 +127,22 @@ BOOST_AUTO_TEST_CASE(siphash)
     CHashWriter ss(SER_DISK, CLIENT_VERSION);
     ss << CTransaction();
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
+
+    // Check the batched version against the single one, including the
+    // values left over after the last full batch
+    std::vector<uint256> vals(11);
+    std::vector<const uint256*> ptrs;
+    for (size_t i = 0; i < vals.size(); i++) {
+        vals[i] = GetRandHash();
+        ptrs.push_back(&vals[i]);
+    }
+    for (size_t count = 0; count <= vals.size(); count++) {
+        std::vector<uint64_t> out(count + 1, 0);
+        SipHashUint256Batch(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, ptrs.data(), count, out.data());
+        for (size_t i = 0; i < count; i++)
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals[i]));
+        BOOST_CHECK_EQUAL(out[count], 0U);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
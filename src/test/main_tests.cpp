@@ -4,6 +4,8 @@
 
 #include "chainparams.h"
 #include "main.h"
+#include "streams.h"
+#include "undo.h"
 
 #include "test/test_bitcoin.h"
 
@@ -72,4 +74,44 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block_and_undo, TestChain100Setup)
+{
+    const CMessageHeader::MessageStartChars& messageStart = Params().MessageStart();
+    std::vector<unsigned char> vchBlock, vchUndo;
+
+    // Raw data deserializes to what the regular functions read
+    const CBlockIndex* pindex = chainActive.Tip();
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vchBlock, pindex, messageStart));
+    BOOST_REQUIRE(ReadRawUndoFromDisk(vchUndo, pindex, messageStart));
+
+    CBlock block, blockRaw;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    CDataStream ssBlock(vchBlock, SER_DISK, CLIENT_VERSION);
+    ssBlock >> blockRaw;
+    BOOST_CHECK(ssBlock.empty());
+    BOOST_CHECK(blockRaw.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(blockRaw.vtx.size(), block.vtx.size());
+
+    CBlockUndo blockUndo, blockUndoRaw;
+    BOOST_REQUIRE(UndoReadFromDisk(blockUndo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()));
+    CDataStream ssUndo(vchUndo, SER_DISK, CLIENT_VERSION);
+    ssUndo >> blockUndoRaw;
+    BOOST_CHECK(ssUndo.empty());
+    BOOST_CHECK_EQUAL(blockUndoRaw.vtxundo.size(), blockUndo.vtxundo.size());
+
+    // The block must match the index entry it is read for
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, chainActive.Genesis(), messageStart));
+    CBlockIndex indexOther(*pindex->pprev);
+    indexOther.phashBlock = pindex->phashBlock;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, &indexOther, messageStart));
+
+    // Data written for another network is not read
+    CMessageHeader::MessageStartChars messageStartOther;
+    memcpy(messageStartOther, messageStart, sizeof(messageStartOther));
+    messageStartOther[0] ^= 0xff;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pindex, messageStartOther));
+    BOOST_CHECK(!ReadRawUndoFromDisk(vchUndo, pindex, messageStartOther));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,17 +3,25 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "policy/policy.h"
+#include "random.h"
 #include "txmempool.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
 #include <list>
+#include <map>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
 
+static void RecordRemoval(std::map<uint256, MemPoolRemovalReason>* mapReasons, std::shared_ptr<const CTransaction> ptx, MemPoolRemovalReason reason)
+{
+    (*mapReasons)[ptx->GetHash()] = reason;
+}
+
 BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
 {
     // Test CTxMemPool::remove functionality
@@ -578,4 +586,93 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // txParent -> txChild -> txGrandChild, of which the first two get mined
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000LL).FromTx(txParent, &pool));
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(10000LL).FromTx(txChild, &pool));
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txGrandChild.GetHash(), entry.Fee(10000LL).FromTx(txGrandChild, &pool));
+
+    // txConflict spends the same outpoint as txMined, which is not in the
+    // mempool, and has a child of its own
+    COutPoint outpoint(GetRandHash(), 0);
+    CMutableTransaction txMined;
+    txMined.vin.resize(1);
+    txMined.vin[0].scriptSig = CScript() << OP_11;
+    txMined.vin[0].prevout = outpoint;
+    txMined.vout.resize(1);
+    txMined.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txMined.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction txConflict = txMined;
+    txConflict.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txConflict.GetHash(), entry.Fee(10000LL).FromTx(txConflict, &pool));
+
+    CMutableTransaction txConflictChild;
+    txConflictChild.vin.resize(1);
+    txConflictChild.vin[0].scriptSig = CScript() << OP_11;
+    txConflictChild.vin[0].prevout = COutPoint(txConflict.GetHash(), 0);
+    txConflictChild.vout.resize(1);
+    txConflictChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txConflictChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txConflictChild.GetHash(), entry.Fee(10000LL).FromTx(txConflictChild, &pool));
+    BOOST_CHECK_EQUAL(pool.size(), 5);
+
+    std::map<uint256, MemPoolRemovalReason> mapReasons;
+    pool.NotifyEntryRemoved.connect(boost::bind(&RecordRemoval, &mapReasons, _1, _2));
+
+    std::vector<CTransaction> vtx;
+    vtx.push_back(txParent);
+    vtx.push_back(txChild);
+    vtx.push_back(txMined);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts, false);
+
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    BOOST_CHECK_EQUAL(conflicts.size(), 2);
+    BOOST_CHECK(pool.exists(txGrandChild.GetHash()));
+
+    // The remaining transaction must no longer account for its mined ancestors
+    CTxMemPool::txiter it = pool.mapTx.find(txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), it->GetTxSize());
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), it->GetModifiedFee());
+    BOOST_CHECK_EQUAL(it->GetSigOpCostWithAncestors(), it->GetSigOpCost());
+
+    // Every removal was notified with its reason
+    BOOST_CHECK_EQUAL(mapReasons.size(), 4);
+    BOOST_CHECK(mapReasons[txParent.GetHash()] == MemPoolRemovalReason::BLOCK);
+    BOOST_CHECK(mapReasons[txChild.GetHash()] == MemPoolRemovalReason::BLOCK);
+    BOOST_CHECK(mapReasons[txConflict.GetHash()] == MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK(mapReasons[txConflictChild.GetHash()] == MemPoolRemovalReason::CONFLICT);
+
+    BOOST_CHECK_EQUAL(pool.Expire(1), 1);
+    BOOST_CHECK(mapReasons[txGrandChild.GetHash()] == MemPoolRemovalReason::EXPIRY);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -164,4 +164,101 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_direct_receive)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CNode node(INVALID_SOCKET, CAddress(CService(ipv4Addr, 7777), NODE_NETWORK));
+    LOCK(node.cs_vRecvMsg);
+
+    std::vector<char> payload(700 * 1000);
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = (char)insecure_rand();
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), "block", payload.size());
+
+    // Nothing can be received in place before a large payload has started
+    char* pch = NULL;
+    BOOST_CHECK_EQUAL(node.GetDirectRecvSpace(pch), 0U);
+    BOOST_CHECK(node.ReceiveMsgBytes(&ssHeader[0], ssHeader.size()));
+
+    size_t nPos = 0;
+    unsigned int nDirect = 0;
+    while (nPos < payload.size()) {
+        unsigned int nSpace = node.GetDirectRecvSpace(pch);
+        if (nSpace > 0) {
+            // Like recv(), fill only part of the offered space
+            unsigned int nBytes = std::min<size_t>(std::min(nSpace, 50000U), payload.size() - nPos);
+            memcpy(pch, &payload[nPos], nBytes);
+            BOOST_CHECK(node.ReceiveMsgBytes(pch, nBytes));
+            nPos += nBytes;
+            nDirect += nBytes;
+        } else {
+            unsigned int nBytes = std::min<size_t>(1000, payload.size() - nPos);
+            BOOST_CHECK(node.ReceiveMsgBytes(&payload[nPos], nBytes));
+            nPos += nBytes;
+        }
+    }
+
+    // Only the tail of the message goes through the copying path
+    BOOST_CHECK(nDirect > payload.size() - 0x10000);
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    const CNetMessage& msg = node.vRecvMsg.front();
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), msg.vRecv.begin()));
+    BOOST_CHECK_EQUAL(node.GetDirectRecvSpace(pch), 0U);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_send_data_batched)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    // Inbound, so nothing (like a version message) is queued on connect
+    CNode node(fds[0], CAddress(CService(ipv4Addr, 7777), NODE_NETWORK), "", true);
+
+    {
+        // Something already queued keeps EndMessage from sending by itself
+        LOCK(node.cs_vSend);
+        node.vSendMsg.push_back(CSerializeData(1, 'x'));
+        node.nSendSize += 1;
+    }
+
+    // More messages than fit in a single gathered write, one of them
+    // large enough to be queued without copying
+    std::vector<char> expected;
+    for (int i = 0; i < 100; i++) {
+        node.BeginMessage("ping");
+        node.ssSend << (uint64_t)i;
+        if (i == 50)
+            node.ssSend << std::vector<unsigned char>(70000, i);
+        node.EndMessage("ping");
+    }
+    {
+        LOCK(node.cs_vSend);
+        BOOST_CHECK_EQUAL(node.vSendMsg.size(), 101U);
+        node.vSendMsg.pop_front();
+        node.nSendSize -= 1;
+        BOOST_FOREACH(const CSerializeData& data, node.vSendMsg)
+            expected.insert(expected.end(), data.begin(), data.end());
+        SocketSendData(&node);
+        BOOST_CHECK(node.vSendMsg.empty());
+        BOOST_CHECK_EQUAL(node.nSendSize, 0U);
+        BOOST_CHECK_EQUAL(node.nSendOffset, 0U);
+    }
+
+    std::vector<char> received(expected.size());
+    size_t nPos = 0;
+    while (nPos < received.size()) {
+        ssize_t nBytes = recv(fds[1], &received[nPos], received.size() - nPos, 0);
+        BOOST_REQUIRE(nBytes > 0);
+        nPos += nBytes;
+    }
+    BOOST_CHECK(received == expected);
+    close(fds[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,14 +4,18 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonstream.h"
 
 #include "base58.h"
+#include "chainparams.h"
+#include "net.h"
 #include "netbase.h"
 
 #include "test/test_bitcoin.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <univalue.h>
@@ -48,6 +52,13 @@ UniValue CallRPC(string args)
     }
 }
 
+static UniValue CallRPCValues(string strMethod, string args)
+{
+    vector<string> vArgs;
+    if (!args.empty())
+        boost::split(vArgs, args, boost::is_any_of(" \t"));
+    return RPCConvertValues(strMethod, vArgs);
+}
 
 BOOST_FIXTURE_TEST_SUITE(rpc_tests, TestingSetup)
 
@@ -309,6 +320,51 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_processingtotals)
+{
+    CAddress addr(CService(CNetAddr("10.11.12.1"), 8333), NODE_NONE);
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&dummyNode);
+    }
+
+    UniValue r;
+    BOOST_CHECK_NO_THROW(r = CallRPC(string("getprocessingtotals")));
+    uint64_t nCount = find_value(find_value(r.get_obj(), "total").get_obj(), "count").get_int64();
+    UniValue ping = find_value(find_value(r.get_obj(), "per_msg").get_obj(), "ping");
+    uint64_t nPingCount = ping.isNull() ? 0 : find_value(ping.get_obj(), "count").get_int64();
+    double dPingWallTime = ping.isNull() ? 0 : find_value(ping.get_obj(), "walltime").get_real();
+
+    CMsgProcessTime time;
+    time.nCount = 1;
+    time.nWallMicros = 3000;
+    time.nCPUMicros = 2000;
+    time.nLockWaitMicros = 1000;
+    dummyNode.RecordProcessTime(NetMsgType::PING, time);
+    // Unknown message types are accounted together
+    dummyNode.RecordProcessTime("notacommand", time);
+
+    BOOST_CHECK_NO_THROW(r = CallRPC(string("getprocessingtotals")));
+    BOOST_CHECK_EQUAL(find_value(find_value(r.get_obj(), "total").get_obj(), "count").get_int64(), nCount + 2);
+    ping = find_value(find_value(r.get_obj(), "per_msg").get_obj(), "ping");
+    BOOST_CHECK_EQUAL(find_value(ping.get_obj(), "count").get_int64(), nPingCount + 1);
+    BOOST_CHECK_CLOSE(find_value(ping.get_obj(), "walltime").get_real(), dPingWallTime + 0.003, 0.001);
+    BOOST_CHECK(!find_value(find_value(r.get_obj(), "per_msg").get_obj(), "*other*").isNull());
+
+    UniValue peers = find_value(r.get_obj(), "peers");
+    BOOST_REQUIRE_EQUAL(peers.size(), 1U);
+    UniValue processTime = find_value(peers[0].get_obj(), "processtime");
+    BOOST_CHECK_EQUAL(find_value(processTime.get_obj(), "count").get_int64(), 2);
+    BOOST_CHECK_CLOSE(find_value(processTime.get_obj(), "cputime").get_real(), 0.004, 0.001);
+    BOOST_CHECK_CLOSE(find_value(processTime.get_obj(), "lockwaittime").get_real(), 0.002, 0.001);
+
+    {
+        LOCK(cs_vNodes);
+        vNodes.erase(std::find(vNodes.begin(), vNodes.end(), &dummyNode));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
 {
     UniValue result;
@@ -332,4 +388,160 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+static void AppendToString(std::string* str, const char* data, size_t size)
+{
+    str->append(data, size);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_jsonstream_writer)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("quote\"d", "line\nbreak"));
+    inner.push_back(Pair("empty_array", UniValue(UniValue::VARR)));
+    inner.push_back(Pair("empty_object", UniValue(UniValue::VOBJ)));
+    UniValue array(UniValue::VARR);
+    array.push_back(1);
+    array.push_back(-2.5);
+    array.push_back(true);
+    array.push_back(NullUniValue);
+    array.push_back(inner);
+    UniValue value(UniValue::VOBJ);
+    value.push_back(Pair("array", array));
+    value.push_back(Pair("inner", inner));
+    value.push_back(Pair("string", std::string(100, 'x')));
+
+    // Whole values come out as UniValue::write() writes them, whatever the chunk size
+    for (size_t nChunkSize = 1; nChunkSize <= 64; nChunkSize *= 4) {
+        std::string str;
+        CJSONStreamWriter writer(boost::bind(&AppendToString, &str, _1, _2), nChunkSize);
+        writer.Value(value);
+        writer.Flush();
+        BOOST_CHECK_EQUAL(str, value.write());
+    }
+
+    // Data is handed to the sink once a chunk is full
+    std::string str;
+    CJSONStreamWriter writer(boost::bind(&AppendToString, &str, _1, _2), 16);
+    writer.BeginArray();
+    BOOST_CHECK(str.empty());
+    writer.Value(std::string(20, 'y'));
+    BOOST_CHECK(!str.empty());
+
+    // Piecewise writes
+    writer.BeginObject();
+    writer.Members(inner);
+    writer.Key("array");
+    writer.BeginArray();
+    for (size_t i = 0; i < array.size(); i++)
+        writer.Value(array[i]);
+    writer.EndArray();
+    writer.EndObject();
+    writer.Value(value);
+    writer.EndArray();
+    writer.Raw("\n");
+    writer.Flush();
+
+    UniValue inner2 = inner;
+    inner2.push_back(Pair("array", array));
+    UniValue expected(UniValue::VARR);
+    expected.push_back(std::string(20, 'y'));
+    expected.push_back(inner2);
+    expected.push_back(value);
+    BOOST_CHECK_EQUAL(str, expected.write() + "\n");
+}
+
+static std::string CallRPCStream(const std::string& strMethod, const UniValue& params)
+{
+    std::string str;
+    CJSONStreamWriter writer(boost::bind(&AppendToString, &str, _1, _2), 64);
+    BOOST_REQUIRE(tableRPC[strMethod]->streamActor);
+    BOOST_CHECK(tableRPC[strMethod]->streamActor(params, writer));
+    writer.Flush();
+    return str;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stream_actors)
+{
+    // Streamed results are the same as the returned ones
+    std::string strHash = Params().GenesisBlock().GetHash().GetHex();
+    BOOST_CHECK_EQUAL(CallRPCStream("getblock", CallRPCValues("getblock", strHash)), CallRPC("getblock " + strHash).write());
+    BOOST_CHECK_EQUAL(CallRPCStream("getblock", CallRPCValues("getblock", strHash + " true")), CallRPC("getblock " + strHash + " true").write());
+    BOOST_CHECK_EQUAL(CallRPCStream("getrawmempool", CallRPCValues("getrawmempool", "")), CallRPC("getrawmempool").write());
+    BOOST_CHECK_EQUAL(CallRPCStream("getrawmempool", CallRPCValues("getrawmempool", "true")), CallRPC("getrawmempool true").write());
+
+    // The hex encoding is left to the actor, as are errors in the arguments count
+    std::string str;
+    CJSONStreamWriter writer(boost::bind(&AppendToString, &str, _1, _2));
+    BOOST_CHECK(!tableRPC["getblock"]->streamActor(CallRPCValues("getblock", strHash + " false"), writer));
+    BOOST_CHECK(!tableRPC["getblock"]->streamActor(UniValue(UniValue::VARR), writer));
+    BOOST_CHECK(!tableRPC["getrawmempool"]->streamActor(CallRPCValues("getrawmempool", "true true"), writer));
+    writer.Flush();
+    BOOST_CHECK(str.empty());
+
+    // Errors are thrown before anything is written
+    BOOST_CHECK_THROW(tableRPC["getblock"]->streamActor(CallRPCValues("getblock", std::string(64, '0')), writer), UniValue);
+    writer.Flush();
+    BOOST_CHECK(str.empty());
+}
+
+static std::string ExecBatch(const UniValue& vReq)
+{
+    std::string str;
+    CJSONStreamWriter writer(boost::bind(&AppendToString, &str, _1, _2));
+    JSONRPCExecBatch(vReq, writer);
+    writer.Flush();
+    return str;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+    std::string strHash = Params().GenesisBlock().GetHash().GetHex();
+
+    // Read-only calls, with errors among them and calls that run on their own
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 40; i++) {
+        UniValue params(UniValue::VARR);
+        std::string strMethod;
+        switch (i % 8) {
+        case 0: strMethod = "getblockcount"; break;
+        case 1: strMethod = "getblockhash"; params.push_back(UniValue(0)); break;
+        case 2: strMethod = "getblockheader"; params.push_back(strHash); break;
+        case 3: strMethod = "getblock"; params.push_back(strHash); break;
+        case 4: strMethod = "getblockheader"; params.push_back(std::string(64, '0')); break;
+        case 5: strMethod = "gettxout"; params.push_back(strHash); params.push_back(UniValue(0)); break;
+        case 6: strMethod = (i % 16 == 6) ? "getchaintips" : "getbestblockhash"; break;
+        case 7: strMethod = (i % 16 == 7) ? "nosuchmethod" : "getdifficulty"; break;
+        }
+        UniValue request(UniValue::VOBJ);
+        request.push_back(Pair("method", strMethod));
+        request.push_back(Pair("params", params));
+        request.push_back(Pair("id", i));
+        vReq.push_back(request);
+    }
+
+    // Replies are in the order of the requests, as when executed one by one
+    std::string strExpected = "[";
+    for (size_t i = 0; i < vReq.size(); i++) {
+        UniValue vOne(UniValue::VARR);
+        vOne.push_back(vReq[i]);
+        std::string strOne = ExecBatch(vOne);
+        strExpected += (i ? "," : "") + strOne.substr(1, strOne.size() - 2);
+    }
+    strExpected += "]";
+
+    BOOST_CHECK_EQUAL(ExecBatch(vReq), strExpected);
+
+    // With the batch threads running
+    BOOST_CHECK(StartRPC());
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK_EQUAL(ExecBatch(vReq), strExpected);
+    InterruptRPC();
+    StopRPC();
+
+    // Batches are still executed after the batch threads are stopped
+    BOOST_CHECK_EQUAL(ExecBatch(vReq), strExpected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 
 #include "test_bitcoin.h"
 
+#include "baseindex.h"
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
@@ -17,8 +18,10 @@
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
+#include "utiltime.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 
 #include "test/testutil.h"
 
@@ -34,6 +37,8 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
+        InitSignatureCache();
+        InitScriptExecutionCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
@@ -125,6 +130,39 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
     return result;
 }
 
+void TestChain100Setup::StartIndexSync(CBaseIndex& index)
+{
+    // Nothing is indexed until the index thread runs
+    BOOST_CHECK(!index.IsSynced());
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    indexSyncThread.reset(new boost::thread(boost::bind(&CBaseIndex::ThreadSync, &index)));
+    int64_t nTimeout = GetTimeMillis() + 10000;
+    while (!index.IsSynced()) {
+        BOOST_REQUIRE(GetTimeMillis() < nTimeout);
+        MilliSleep(10);
+    }
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+}
+
+CBlock
+TestChain100Setup::CreateAndIndexBlock(CBaseIndex& index, const CScript& scriptPubKey)
+{
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    return block;
+}
+
+void TestChain100Setup::StopIndexSync()
+{
+    if (!indexSyncThread)
+        return;
+    indexSyncThread->interrupt();
+    indexSyncThread->join();
+    indexSyncThread.reset();
+}
+
 TestChain100Setup::~TestChain100Setup()
 {
 }
@@ -12,6 +12,7 @@
 #include "txmempool.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 /** Basic testing setup.
@@ -36,6 +37,7 @@ struct TestingSetup: public BasicTestingSetup {
     ~TestingSetup();
 };
 
+class CBaseIndex;
 class CBlock;
 struct CMutableTransaction;
 class CScript;
@@ -52,8 +54,22 @@ struct TestChain100Setup : public TestingSetup {
     CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& txns,
                                  const CScript& scriptPubKey);
 
+    // Run the sync thread of an index that has not started yet, and wait
+    // until it has caught up with the chain.
+    void StartIndexSync(CBaseIndex& index);
+
+    // Create a new block paying to scriptPubKey, like CreateAndProcessBlock,
+    // and wait until the index covers it.
+    CBlock CreateAndIndexBlock(CBaseIndex& index, const CScript& scriptPubKey);
+
+    // Interrupt the index sync thread and wait for it to finish. Must be
+    // called before the index is destroyed.
+    void StopIndexSync();
+
     ~TestChain100Setup();
 
+    boost::scoped_ptr<boost::thread> indexSyncThread;
+
     std::vector<CTransaction> coinbaseTxns; // For convenience, coinbase transactions
     CKey coinbaseKey; // private/public key needed to spend coinbase transactions
 };
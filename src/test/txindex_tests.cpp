@@ -0,0 +1,48 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "txdb.h"
+#include "txindex.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(txindex_initial_sync)
+{
+    CTxIndex txindex;
+    CDiskTxPos postx;
+
+    BOOST_CHECK(!pblocktree->ReadTxIndex(coinbaseTxns[0].GetHash(), postx));
+    StartIndexSync(txindex);
+
+    // Transactions are found through the index, not the block scan fallback
+    fTxIndex = true;
+    BOOST_FOREACH(const CTransaction& coinbase, coinbaseTxns) {
+        BOOST_CHECK(pblocktree->ReadTxIndex(coinbase.GetHash(), postx));
+        CTransaction tx;
+        uint256 hashBlock;
+        BOOST_CHECK(GetTransaction(coinbase.GetHash(), tx, Params().GetConsensus(), hashBlock, false));
+        BOOST_CHECK(tx.GetHash() == coinbase.GetHash());
+        BOOST_CHECK(!hashBlock.IsNull());
+    }
+
+    CBlock block = CreateAndIndexBlock(txindex, CScript() << OP_TRUE);
+    BOOST_CHECK(pblocktree->ReadTxIndex(block.vtx[0].GetHash(), postx));
+    fTxIndex = false;
+
+    // The last indexed block is stored when the thread stops
+    StopIndexSync();
+    CBlockLocator locator;
+    BOOST_CHECK(pblocktree->ReadTxIndexBestBlock(locator));
+    BOOST_REQUIRE(!locator.vHave.empty());
+    BOOST_CHECK(locator.vHave[0] == chainActive.Tip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
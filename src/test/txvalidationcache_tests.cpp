@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "coins.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "main.h"
@@ -83,4 +84,80 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_execution_cache, TestingSetup)
+{
+    // Scripts that passed with cacheFullScriptStore are not run again for
+    // the same transaction and flags.
+    LOCK(cs_main);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache view(&coinsDummy);
+    view.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    uint256 prevHash = GetRandHash();
+    {
+        CCoinsModifier coins = view.ModifyCoins(prevHash);
+        coins->fCoinBase = false;
+        coins->nHeight = 1;
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 11*CENT;
+        coins->vout[0].scriptPubKey = scriptPubKey;
+    }
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(prevHash, 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 10*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const CTransaction tx(spend);
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    CValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    std::vector<CScriptCheck> vChecks;
+
+    // Not cached yet: the script check is handed back to the caller.
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Validate inline and store the result.
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, true, txdata));
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    // Different flags are a different cache entry.
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags | SCRIPT_VERIFY_LOW_S, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // So is a different witness of the same transaction.
+    CMutableTransaction malleated(spend);
+    malleated.wit.vtxinwit.resize(1);
+    malleated.wit.vtxinwit[0].scriptWitness.stack.push_back(std::vector<unsigned char>(1, 0));
+    const CTransaction txMalleated(malleated);
+    PrecomputedTransactionData txdataMalleated(txMalleated);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txMalleated, state, view, true, flags, false, false, txdataMalleated, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Queued checks must not populate the cache.
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txMalleated, state, view, true, flags, true, true, txdataMalleated, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txMalleated, state, view, true, flags, false, false, txdataMalleated, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,9 +19,13 @@ using namespace std;
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_TXINDEX_BEST_BLOCK = 'T';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
@@ -159,6 +163,101 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxIndexBestBlock(CBlockLocator &locator) {
+    return Read(DB_TXINDEX_BEST_BLOCK, locator);
+}
+
+bool CBlockTreeDB::WriteTxIndexBestBlock(const CBlockLocator &locator) {
+    return Write(DB_TXINDEX_BEST_BLOCK, locator);
+}
+
+static void UpdateAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent) {
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vUnspent.begin(); it!=vUnspent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+}
+
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                                     const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vIndex.begin(); it!=vIndex.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    UpdateAddressUnspentIndex(batch, vUnspent);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                                     const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vIndex.begin(); it!=vIndex.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    UpdateAddressUnspentIndex(batch, vUnspent);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(unsigned int type, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                                    int nStartHeight, int nEndHeight, const leveldb::Snapshot* snapshot) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+
+    if (nStartHeight > 0)
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, hashBytes, nStartHeight)));
+    else
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, hashBytes)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != type || key.second.hashBytes != hashBytes)
+            break;
+        if (nEndHeight > 0 && key.second.blockHeight > nEndHeight)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read value", __func__);
+        vIndex.push_back(make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(unsigned int type, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent,
+                                           const leveldb::Snapshot* snapshot) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, hashBytes)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX || key.second.type != type || key.second.hashBytes != hashBytes)
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read value", __func__);
+        vUnspent.push_back(make_pair(key.second, value));
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    return Read(make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vSpent) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=vSpent.begin(); it!=vSpent.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
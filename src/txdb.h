@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
@@ -33,6 +34,8 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+//! Max memory allocated to the block filter index DB specific cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -114,6 +117,18 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadTxIndexBestBlock(CBlockLocator &locator);
+    bool WriteTxIndexBestBlock(const CBlockLocator &locator);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                           const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                           const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent);
+    bool ReadAddressIndex(unsigned int type, const uint160 &hashBytes, std::vector<std::pair<CAddressIndexKey, CAmount> > &vIndex,
+                          int nStartHeight = 0, int nEndHeight = 0, const leveldb::Snapshot* snapshot = NULL);
+    bool ReadAddressUnspentIndex(unsigned int type, const uint160 &hashBytes, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vUnspent,
+                                 const leveldb::Snapshot* snapshot = NULL);
+    bool ReadSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vSpent);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
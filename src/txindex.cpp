@@ -0,0 +1,49 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "chain.h"
+#include "main.h"
+#include "txdb.h"
+
+#include <boost/foreach.hpp>
+
+CTxIndex* ptxindex = NULL;
+
+const CBlockIndex* CTxIndex::GetInitialBestBlock()
+{
+    // Databases from before the index was built in the background have every
+    // block up to the chain tip indexed if the txindex flag is set.
+    bool fOldIndex = false;
+    if (pblocktree->ReadFlag("txindex", fOldIndex) && fOldIndex)
+        return chainActive.Tip();
+    return NULL;
+}
+
+bool CTxIndex::ReadBestBlockLocator(CBlockLocator& locator)
+{
+    return pblocktree->ReadTxIndexBestBlock(locator);
+}
+
+bool CTxIndex::WriteBestBlockLocator(const CBlockLocator& locator)
+{
+    return pblocktree->WriteTxIndexBestBlock(locator);
+}
+
+bool CTxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block's transactions cannot be spent and were never indexed
+    if (pindex->nHeight == 0)
+        return true;
+
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.reserve(block.vtx.size());
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    return pblocktree->WriteTxIndex(vPos);
+}
@@ -0,0 +1,28 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include "baseindex.h"
+
+/**
+ * The transaction index (-txindex), built in the background. Entries of
+ * blocks that get disconnected are left in place; the transactions are
+ * indexed again if they are included in another block.
+ */
+class CTxIndex : public CBaseIndex
+{
+protected:
+    const char* GetName() const { return "transaction index"; }
+    const CBlockIndex* GetInitialBestBlock();
+    bool ReadBestBlockLocator(CBlockLocator& locator);
+    bool WriteBestBlockLocator(const CBlockLocator& locator);
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+};
+
+/** The transaction index, if -txindex is set */
+extern CTxIndex* ptxindex;
+
+#endif // BITCOIN_TXINDEX_H
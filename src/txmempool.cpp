@@ -270,6 +270,19 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
     }
 }
 
+namespace {
+/** Ancestor state change accumulated for one descendant of removed entries. */
+struct AncestorStateDelta
+{
+    int64_t modifySize;
+    CAmount modifyFee;
+    int64_t modifyCount;
+    int64_t modifySigOpsCost;
+
+    AncestorStateDelta() : modifySize(0), modifyFee(0), modifyCount(0), modifySigOpsCost(0) {}
+};
+}
+
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
     // For each entry, walk back all ancestors and decrement size associated with this
@@ -282,17 +295,28 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // Here we only update statistics and not data in mapLinks (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
+        // Descendants that are being removed as well are skipped, and the
+        // changes from all removed ancestors are summed first, so that each
+        // remaining descendant is modified once even when a whole package
+        // is confirmed in the same block.
+        std::map<txiter, AncestorStateDelta, CompareIteratorByHash> mapDescendantDeltas;
         BOOST_FOREACH(txiter removeIt, entriesToRemove) {
             setEntries setDescendants;
             CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
             BOOST_FOREACH(txiter dit, setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                if (entriesToRemove.count(dit))
+                    continue; // also skips self
+                AncestorStateDelta &delta = mapDescendantDeltas[dit];
+                delta.modifySize -= removeIt->GetTxSize();
+                delta.modifyFee -= removeIt->GetModifiedFee();
+                delta.modifyCount -= 1;
+                delta.modifySigOpsCost -= removeIt->GetSigOpCost();
             }
         }
+        for (auto dit = mapDescendantDeltas.begin(); dit != mapDescendantDeltas.end(); ++dit) {
+            const AncestorStateDelta &delta = dit->second;
+            mapTx.modify(dit->first, update_ancestor_state(delta.modifySize, delta.modifyFee, delta.modifyCount, delta.modifySigOpsCost));
+        }
     }
     BOOST_FOREACH(txiter removeIt, entriesToRemove) {
         setEntries setAncestors;
@@ -450,8 +474,9 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
-void CTxMemPool::removeUnchecked(txiter it)
+void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
+    NotifyEntryRemoved(it->GetSharedTx(), reason);
     const uint256 hash = it->GetTx().GetHash();
     BOOST_FOREACH(const CTxIn& txin, it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
@@ -503,7 +528,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
     }
 }
 
-void CTxMemPool::removeRecursive(const CTransaction &origTx, std::list<CTransaction>& removed)
+void CTxMemPool::removeRecursive(const CTransaction &origTx, std::list<CTransaction>& removed, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
     {
@@ -533,7 +558,7 @@ void CTxMemPool::removeRecursive(const CTransaction &origTx, std::list<CTransact
         BOOST_FOREACH(txiter it, setAllRemoves) {
             removed.push_back(it->GetTx());
         }
-        RemoveStaged(setAllRemoves, false);
+        RemoveStaged(setAllRemoves, false, reason);
     }
 }
 
@@ -569,7 +594,7 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
     }
     BOOST_FOREACH(const CTransaction& tx, transactionsToRemove) {
         list<CTransaction> removed;
-        removeRecursive(tx, removed);
+        removeRecursive(tx, removed, MemPoolRemovalReason::REORG);
     }
 }
 
@@ -584,7 +609,7 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
             const CTransaction &txConflict = *it->second;
             if (txConflict != tx)
             {
-                removeRecursive(txConflict, removed);
+                removeRecursive(txConflict, removed, MemPoolRemovalReason::CONFLICT);
                 ClearPrioritisation(txConflict.GetHash());
             }
         }
@@ -593,31 +618,58 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
+ *
+ * The block is handled in one pass: every in-mempool transaction of the block
+ * is staged and removed together, then all transactions conflicting with the
+ * block are removed (with their descendants) as a single set.
  */
 void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
                                 std::list<CTransaction>& conflicts, bool fCurrentEstimate)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
-    {
-        uint256 hash = tx.GetHash();
-
-        indexed_transaction_set::iterator i = mapTx.find(hash);
-        if (i != mapTx.end())
-            entries.push_back(*i);
-    }
+    entries.reserve(vtx.size());
+    setEntries stage;
     BOOST_FOREACH(const CTransaction& tx, vtx)
     {
         txiter it = mapTx.find(tx.GetHash());
         if (it != mapTx.end()) {
-            setEntries stage;
+            entries.push_back(*it);
             stage.insert(it);
-            RemoveStaged(stage, true);
         }
-        removeConflicts(tx, conflicts);
-        ClearPrioritisation(tx.GetHash());
     }
+    // Any in-mempool ancestor of a transaction in a valid block is in the
+    // block as well, so the whole set can be removed at once; descendants
+    // left behind get their ancestor state updated once for the set.
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
+
+    // The block's own spends are gone from mapNextTx now, so whatever still
+    // spends one of its inputs is a conflict.
+    setEntries setConflicts;
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+    {
+        BOOST_FOREACH(const CTxIn &txin, tx.vin) {
+            auto it = mapNextTx.find(txin.prevout);
+            if (it == mapNextTx.end())
+                continue;
+            txiter conflictit = mapTx.find(it->second->GetHash());
+            assert(conflictit != mapTx.end());
+            if (setConflicts.insert(conflictit).second)
+                mapDeltas.erase(conflictit->GetTx().GetHash());
+        }
+        mapDeltas.erase(tx.GetHash());
+    }
+    if (!setConflicts.empty()) {
+        setEntries setAllRemoves;
+        BOOST_FOREACH(txiter it, setConflicts) {
+            CalculateDescendants(it, setAllRemoves);
+        }
+        BOOST_FOREACH(txiter it, setAllRemoves) {
+            conflicts.push_back(it->GetTx());
+        }
+        RemoveStaged(setAllRemoves, false, MemPoolRemovalReason::CONFLICT);
+    }
+
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
     lastRollingFeeUpdate = GetTime();
@@ -738,7 +790,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         else {
             CValidationState state;
             PrecomputedTransactionData txdata(tx);
-            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, txdata, NULL));
+            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, false, txdata, NULL));
             UpdateCoins(tx, mempoolDuplicate, 1000000);
         }
     }
@@ -753,7 +805,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(stepsSinceLastRemove < waitingOnDependants.size());
         } else {
             PrecomputedTransactionData txdata(entry->GetTx());
-            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, txdata, NULL));
+            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, false, txdata, NULL));
             UpdateCoins(entry->GetTx(), mempoolDuplicate, 1000000);
             stepsSinceLastRemove = 0;
         }
@@ -988,11 +1040,11 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
     return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
-void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants) {
+void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
     UpdateForRemoveFromMempool(stage, updateDescendants);
     BOOST_FOREACH(const txiter& it, stage) {
-        removeUnchecked(it);
+        removeUnchecked(it, reason);
     }
 }
 
@@ -1008,7 +1060,7 @@ int CTxMemPool::Expire(int64_t time) {
     BOOST_FOREACH(txiter removeit, toremove) {
         CalculateDescendants(removeit, stage);
     }
-    RemoveStaged(stage, false);
+    RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
     return stage.size();
 }
 
@@ -1090,7 +1142,7 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining, std::vector<std::shared_ptr<const CTransaction> >* pvTxnRemoved) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
@@ -1117,7 +1169,11 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
             BOOST_FOREACH(txiter it, stage)
                 txn.push_back(it->GetTx());
         }
-        RemoveStaged(stage, false);
+        if (pvTxnRemoved) {
+            BOOST_FOREACH(txiter it, stage)
+                pvTxnRemoved->push_back(it->GetSharedTx());
+        }
+        RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
         if (pvNoSpendsRemaining) {
             BOOST_FOREACH(const CTransaction& tx, txn) {
                 BOOST_FOREACH(const CTxIn& txin, tx.vin) {
@@ -9,6 +9,12 @@
 
 #include "utiltime.h"
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
 
@@ -54,6 +60,26 @@ int64_t GetLogTimeMicros()
     return GetTimeMicros();
 }
 
+int64_t GetThreadCPUTimeMicros()
+{
+#if defined(WIN32)
+    FILETIME ftCreation, ftExit, ftKernel, ftUser;
+    if (!GetThreadTimes(GetCurrentThread(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+        return 0;
+    // FILETIMEs count 100-nanosecond intervals
+    uint64_t nKernel = ((uint64_t)ftKernel.dwHighDateTime << 32) | ftKernel.dwLowDateTime;
+    uint64_t nUser = ((uint64_t)ftUser.dwHighDateTime << 32) | ftUser.dwLowDateTime;
+    return (nKernel + nUser) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
+
 void MilliSleep(int64_t n)
 {
 
@@ -13,6 +13,8 @@ int64_t GetTime();
 int64_t GetTimeMillis();
 int64_t GetTimeMicros();
 int64_t GetLogTimeMicros();
+/** CPU time used by the calling thread in microseconds, or 0 where that is not available */
+int64_t GetThreadCPUTimeMicros();
 void SetMockTime(int64_t nMockTimeIn);
 void MilliSleep(int64_t n);
 
@@ -8,6 +8,7 @@
 
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
+#include <memory>
 
 class CBlock;
 class CBlockIndex;
@@ -16,8 +17,10 @@ class CBlockIndex;
 class CReserveScript;
 class CTransaction;
 class CValidationInterface;
+class CTxMemPool;
 class CValidationState;
 class uint256;
+enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
@@ -27,6 +30,10 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/** Forward transactions leaving a mempool to the registered interfaces */
+void RegisterWithMempoolSignals(CTxMemPool& pool);
+/** Stop forwarding transactions leaving a mempool */
+void UnregisterWithMempoolSignals(CTxMemPool& pool);
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock = NULL);
 
@@ -34,6 +41,8 @@ class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, const CBlock *pblock) {}
+    virtual void TransactionRemovedFromMempool(std::shared_ptr<const CTransaction> ptx, MemPoolRemovalReason reason) {}
+    virtual void BlockDisconnected(const CBlock &block, const CBlockIndex *pindex) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
@@ -51,6 +60,10 @@ struct CMainSignals {
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of a transaction leaving the mempool, and why. Called with the mempool lock held. */
+    boost::signals2::signal<void (std::shared_ptr<const CTransaction>, MemPoolRemovalReason)> TransactionRemovedFromMempool;
+    /** Notifies listeners of a block disconnected from the active chain (the block, and its index entry) */
+    boost::signals2::signal<void (const CBlock &, const CBlockIndex *)> BlockDisconnected;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -2581,54 +2581,54 @@ extern UniValue getcheckpoint(const UniValue& params, bool fHelp);
 extern UniValue sendcheckpoint(const UniValue& params, bool fHelp);
 
 static const CRPCCommand commands[] =
-{ //  category              name                        actor (function)           okSafeMode
-    //  --------------------- ------------------------    -----------------------    ----------
-    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false },
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true  },
-    { "wallet",             "abandontransaction",       &abandontransaction,       false },
-    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
-    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true  },
-    { "wallet",             "backupwallet",             &backupwallet,             true  },
-    { "wallet",             "dumpprivkey",              &dumpprivkey,              true  },
-    { "wallet",             "dumpwallet",               &dumpwallet,               true  },
-    { "wallet",             "encryptwallet",            &encryptwallet,            true  },
-    { "wallet",             "getaccountaddress",        &getaccountaddress,        true  },
-    { "wallet",             "getaccount",               &getaccount,               true  },
-    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true  },
-    { "wallet",             "getbalance",               &getbalance,               false },
-    { "wallet",             "getnewaddress",            &getnewaddress,            true  },
-    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true  },
-    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false },
-    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false },
-    { "wallet",             "gettransaction",           &gettransaction,           false },
-    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false },
-    { "wallet",             "getwalletinfo",            &getwalletinfo,            false },
-    { "wallet",             "importprivkey",            &importprivkey,            true  },
-    { "wallet",             "importwallet",             &importwallet,             true  },
-    { "wallet",             "importaddress",            &importaddress,            true  },
-    { "wallet",             "importprunedfunds",        &importprunedfunds,        true  },
-    { "wallet",             "importpubkey",             &importpubkey,             true  },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true  },
-    { "wallet",             "listaccounts",             &listaccounts,             false },
-    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false },
-    { "wallet",             "listlockunspent",          &listlockunspent,          false },
-    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false },
-    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false },
-    { "wallet",             "listsinceblock",           &listsinceblock,           false },
-    { "wallet",             "listtransactions",         &listtransactions,         false },
-    { "wallet",             "listunspent",              &listunspent,              false },
-    { "wallet",             "lockunspent",              &lockunspent,              true  },
-    { "wallet",             "move",                     &movecmd,                  false },
-    { "wallet",             "sendfrom",                 &sendfrom,                 false },
-    { "wallet",             "sendmany",                 &sendmany,                 false },
-    { "wallet",             "sendtoaddress",            &sendtoaddress,            false },
-    { "wallet",             "setaccount",               &setaccount,               true  },
-    { "wallet",             "settxfee",                 &settxfee,                 true  },
-    { "wallet",             "signmessage",              &signmessage,              true  },
-    { "wallet",             "walletlock",               &walletlock,               true  },
-    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true  },
-    { "wallet",             "walletpassphrase",         &walletpassphrase,         true  },
-    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true  },
+{ //  category              name                        actor (function)           okSafeMode  streamActor            okParallel
+    //  --------------------- ------------------------    -----------------------    ----------  ---------------------  ----------
+    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,      NULL,                  false },
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,       NULL,                  false },
+    { "wallet",             "abandontransaction",       &abandontransaction,       false,      NULL,                  false },
+    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,       NULL,                  false },
+    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,       NULL,                  false },
+    { "wallet",             "backupwallet",             &backupwallet,             true,       NULL,                  false },
+    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,       NULL,                  false },
+    { "wallet",             "dumpwallet",               &dumpwallet,               true,       NULL,                  false },
+    { "wallet",             "encryptwallet",            &encryptwallet,            true,       NULL,                  false },
+    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,       NULL,                  false },
+    { "wallet",             "getaccount",               &getaccount,               true,       NULL,                  false },
+    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,       NULL,                  false },
+    { "wallet",             "getbalance",               &getbalance,               false,      NULL,                  false },
+    { "wallet",             "getnewaddress",            &getnewaddress,            true,       NULL,                  false },
+    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,       NULL,                  false },
+    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,      NULL,                  false },
+    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,      NULL,                  false },
+    { "wallet",             "gettransaction",           &gettransaction,           false,      NULL,                  false },
+    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,      NULL,                  false },
+    { "wallet",             "getwalletinfo",            &getwalletinfo,            false,      NULL,                  false },
+    { "wallet",             "importprivkey",            &importprivkey,            true,       NULL,                  false },
+    { "wallet",             "importwallet",             &importwallet,             true,       NULL,                  false },
+    { "wallet",             "importaddress",            &importaddress,            true,       NULL,                  false },
+    { "wallet",             "importprunedfunds",        &importprunedfunds,        true,       NULL,                  false },
+    { "wallet",             "importpubkey",             &importpubkey,             true,       NULL,                  false },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,       NULL,                  false },
+    { "wallet",             "listaccounts",             &listaccounts,             false,      NULL,                  false },
+    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,      NULL,                  false },
+    { "wallet",             "listlockunspent",          &listlockunspent,          false,      NULL,                  false },
+    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,      NULL,                  false },
+    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,      NULL,                  false },
+    { "wallet",             "listsinceblock",           &listsinceblock,           false,      NULL,                  false },
+    { "wallet",             "listtransactions",         &listtransactions,         false,      NULL,                  false },
+    { "wallet",             "listunspent",              &listunspent,              false,      NULL,                  false },
+    { "wallet",             "lockunspent",              &lockunspent,              true,       NULL,                  false },
+    { "wallet",             "move",                     &movecmd,                  false,      NULL,                  false },
+    { "wallet",             "sendfrom",                 &sendfrom,                 false,      NULL,                  false },
+    { "wallet",             "sendmany",                 &sendmany,                 false,      NULL,                  false },
+    { "wallet",             "sendtoaddress",            &sendtoaddress,            false,      NULL,                  false },
+    { "wallet",             "setaccount",               &setaccount,               true,       NULL,                  false },
+    { "wallet",             "settxfee",                 &settxfee,                 true,       NULL,                  false },
+    { "wallet",             "signmessage",              &signmessage,              true,       NULL,                  false },
+    { "wallet",             "walletlock",               &walletlock,               true,       NULL,                  false },
+    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,       NULL,                  false },
+    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,       NULL,                  false },
+    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true,       NULL,                  false },
 };
 
 void RegisterWalletRPCCommands(CRPCTable &tableRPC)
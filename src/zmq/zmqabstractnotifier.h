@@ -9,13 +9,24 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** The events notifiers publish, one per notifier */
+enum ZMQNotifyEvent
+{
+    ZMQ_EVENT_BLOCK,
+    ZMQ_EVENT_TRANSACTION,
+    ZMQ_EVENT_TRANSACTION_REMOVAL,
+    ZMQ_EVENT_BLOCK_DISCONNECT,
+    ZMQ_EVENT_COUNT
+};
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier(ZMQNotifyEvent eventIn) : psocket(0), event(eventIn) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,15 +39,22 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    ZMQNotifyEvent GetEvent() const { return event; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+
+    /** Account for notifications of this notifier's event that were dropped before being published */
+    virtual void NotificationsDropped(unsigned int nCount) { }
 
 protected:
     void *psocket;
+    ZMQNotifyEvent event;
     std::string type;
     std::string address;
 };
@@ -8,15 +8,21 @@
 #include "version.h"
 #include "main.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
 
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), nMaxQueue(DEFAULT_ZMQ_QUEUE_SIZE), fStopping(false), nStopDeadline(0)
 {
+    std::fill(fEventUsed, fEventUsed + ZMQ_EVENT_COUNT, false);
 }
 
 CZMQNotificationInterface::~CZMQNotificationInterface()
@@ -39,6 +45,8 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubhashtxremoved"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionRemovalNotifier>;
+    factories["pubhashblockdisconnected"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockDisconnectNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -59,6 +67,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
 
+        std::map<std::string, std::string>::const_iterator j = args.find("-zmqqueuesize");
+        if (j != args.end())
+            notificationInterface->nMaxQueue = std::max<int64_t>(1, atoi64(j->second));
+
         if (!notificationInterface->Initialize())
         {
             delete notificationInterface;
@@ -103,6 +115,12 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    for (i=notifiers.begin(); i!=notifiers.end(); ++i)
+        fEventUsed[(*i)->GetEvent()] = true;
+
+    threadPublish = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "zmqpub",
+        boost::function<void()>(boost::bind(&CZMQNotificationInterface::ThreadPublish, this))));
+
     return true;
 }
 
@@ -110,6 +128,18 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (threadPublish.joinable())
+    {
+        // The thread publishes what is still queued before it exits, for as
+        // long as ZMQ_SHUTDOWN_DRAIN_TIME
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            fStopping = true;
+            nStopDeadline = GetTimeMillis() + ZMQ_SHUTDOWN_DRAIN_TIME;
+        }
+        cond.notify_all();
+        threadPublish.join();
+    }
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -124,30 +154,61 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::Enqueue(ZMQNotifyEvent event, const CBlockIndex *pindex, const std::shared_ptr<const CTransaction>& ptx, MemPoolRemovalReason reason)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    if (!fEventUsed[event])
+        return;
+
+    CZMQNotification notification;
+    notification.event = event;
+    notification.pindex = pindex;
+    notification.ptx = ptx;
+    notification.reason = reason;
+    std::fill(notification.nDroppedAfter, notification.nDroppedAfter + ZMQ_EVENT_COUNT, 0);
+
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
-        {
-            i++;
-        }
-        else
+        boost::lock_guard<boost::mutex> lock(cs);
+        if (queue.size() >= nMaxQueue)
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            // Remember the drop with the last queued notification, so the
+            // sequence numbers are skipped right after it is published
+            if (queue.back().nDroppedAfter[event]++ == 0)
+                LogPrint("zmq", "zmq: Queue full, dropping notifications\n");
+            return;
         }
+        queue.push_back(notification);
     }
+    cond.notify_one();
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock)
+void CZMQNotificationInterface::Publish(const CZMQNotification &notification)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        bool fOk = true;
+        switch (notification.event)
+        {
+        case ZMQ_EVENT_BLOCK:
+            fOk = notifier->NotifyBlock(notification.pindex);
+            break;
+        case ZMQ_EVENT_TRANSACTION:
+            fOk = notifier->NotifyTransaction(*notification.ptx);
+            break;
+        case ZMQ_EVENT_TRANSACTION_REMOVAL:
+            fOk = notifier->NotifyTransactionRemoval(*notification.ptx, notification.reason);
+            break;
+        case ZMQ_EVENT_BLOCK_DISCONNECT:
+            fOk = notifier->NotifyBlockDisconnect(notification.pindex);
+            break;
+        default:
+            break;
+        }
+        if (fOk)
         {
+            unsigned int nDropped = notification.nDroppedAfter[notifier->GetEvent()];
+            if (nDropped)
+                notifier->NotificationsDropped(nDropped);
             i++;
         }
         else
@@ -157,3 +218,48 @@ void CZMQNotificationInterface::SyncTransaction(const CTransaction& tx, const CB
         }
     }
 }
+
+void CZMQNotificationInterface::ThreadPublish()
+{
+    while (true)
+    {
+        CZMQNotification notification;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty() && !fStopping)
+                cond.wait(lock);
+            if (queue.empty())
+                return;
+            if (fStopping && GetTimeMillis() > nStopDeadline)
+            {
+                LogPrint("zmq", "zmq: Dropping %u notifications not published at shutdown\n", queue.size());
+                queue.clear();
+                return;
+            }
+            notification = queue.front();
+            queue.pop_front();
+        }
+        Publish(notification);
+    }
+}
+
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    Enqueue(ZMQ_EVENT_BLOCK, pindex, std::shared_ptr<const CTransaction>(), MemPoolRemovalReason::UNKNOWN);
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock)
+{
+    // Only a reference is passed here, so the queue needs a copy
+    Enqueue(ZMQ_EVENT_TRANSACTION, NULL, std::make_shared<const CTransaction>(tx), MemPoolRemovalReason::UNKNOWN);
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(std::shared_ptr<const CTransaction> ptx, MemPoolRemovalReason reason)
+{
+    Enqueue(ZMQ_EVENT_TRANSACTION_REMOVAL, NULL, ptx, reason);
+}
+
+void CZMQNotificationInterface::BlockDisconnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    Enqueue(ZMQ_EVENT_BLOCK_DISCONNECT, pindex, std::shared_ptr<const CTransaction>(), MemPoolRemovalReason::UNKNOWN);
+}
@@ -6,12 +6,31 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include "zmqabstractnotifier.h"
+#include <deque>
+#include <list>
+#include <memory>
 #include <string>
 #include <map>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class CBlockIndex;
-class CZMQAbstractNotifier;
 
+/** Default for -zmqqueuesize, the number of notifications waiting to be published */
+static const unsigned int DEFAULT_ZMQ_QUEUE_SIZE = 10000;
+/** Time in milliseconds Shutdown leaves the queue to be published before dropping what is left */
+static const int64_t ZMQ_SHUTDOWN_DRAIN_TIME = 2000;
+
+/**
+ * Publishes validation events through its notifiers. The events are queued
+ * and published by a thread of its own, so reading blocks from disk or a slow
+ * socket never holds up validation. When the queue is full new events are
+ * dropped; the notifiers skip their sequence numbers so that subscribers can
+ * tell messages were lost.
+ */
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -26,12 +45,41 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void TransactionRemovedFromMempool(std::shared_ptr<const CTransaction> ptx, MemPoolRemovalReason reason);
+    void BlockDisconnected(const CBlock& block, const CBlockIndex *pindex);
 
 private:
+    /** A queued event, with the number of each event dropped after it */
+    struct CZMQNotification
+    {
+        ZMQNotifyEvent event;
+        const CBlockIndex *pindex;
+        std::shared_ptr<const CTransaction> ptx;
+        MemPoolRemovalReason reason;
+        unsigned int nDroppedAfter[ZMQ_EVENT_COUNT];
+    };
+
     CZMQNotificationInterface();
 
+    void Enqueue(ZMQNotifyEvent event, const CBlockIndex *pindex, const std::shared_ptr<const CTransaction>& ptx, MemPoolRemovalReason reason);
+    void Publish(const CZMQNotification &notification);
+    void ThreadPublish();
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+
+    /** Whether any notifier publishes the event; others are never queued */
+    bool fEventUsed[ZMQ_EVENT_COUNT];
+    /** Maximum number of queued notifications (-zmqqueuesize) */
+    size_t nMaxQueue;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<CZMQNotification> queue;
+    bool fStopping;
+    /** When stopping, the time after which queued notifications are dropped */
+    int64_t nStopDeadline;
+    boost::thread threadPublish;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -7,6 +7,7 @@
 #include "main.h"
 #include "util.h"
 #include "rpc/server.h"
+#include "txmempool.h"
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
@@ -14,6 +15,8 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_HASHTXREMOVED         = "hashtxremoved";
+static const char *MSG_HASHBLOCKDISCONNECTED = "hashblockdisconnected";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -165,20 +168,26 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // This runs on the publisher thread, so cs_main is only needed to find the block
     const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    CDiskBlockPos pos;
     {
         LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+        pos = pindex->GetBlockPos();
+    }
 
-        ss << block;
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != pindex->GetBlockHash())
+    {
+        // The block may have been pruned since it was notified; count the
+        // message as lost rather than giving up on the notifier
+        LogPrint("zmq", "zmq: Can't read block %s from disk\n", pindex->GetBlockHash().GetHex());
+        NotificationsDropped(1);
+        return true;
     }
 
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ss << block;
     return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
 }
 
@@ -190,3 +199,27 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishHashTransactionRemovalNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint("zmq", "zmq: Publish hashtxremoved %s (reason %d)\n", hash.GetHex(), (int)reason);
+    /* the hash followed by a one byte removal reason */
+    char data[33];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = (char)reason;
+    return SendMessage(MSG_HASHTXREMOVED, data, 33);
+}
+
+bool CZMQPublishHashBlockDisconnectNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint("zmq", "zmq: Publish hashblockdisconnected %s\n", hash.GetHex());
+    /* the hash followed by the LE 4byte height of the disconnected block */
+    unsigned char data[36];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    WriteLE32(&data[32], pindex->nHeight);
+    return SendMessage(MSG_HASHBLOCKDISCONNECTED, data, 36);
+}
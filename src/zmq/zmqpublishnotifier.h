@@ -15,6 +15,7 @@ private:
     uint32_t nSequence; //!< upcounting per message sequence number
 
 public:
+    CZMQAbstractPublishNotifier(ZMQNotifyEvent eventIn) : CZMQAbstractNotifier(eventIn), nSequence(0) { }
 
     /* send zmq multipart message
        parts:
@@ -24,6 +25,9 @@ public:
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
+    /* skip the sequence numbers of dropped messages, so subscribers see the gap */
+    void NotificationsDropped(unsigned int nCount) { nSequence += nCount; }
+
     bool Initialize(void *pcontext);
     void Shutdown();
 };
@@ -31,25 +35,43 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
+    CZMQPublishHashBlockNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_BLOCK) { }
     bool NotifyBlock(const CBlockIndex *pindex);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
+    CZMQPublishHashTransactionNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_TRANSACTION) { }
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
+    CZMQPublishRawBlockNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_BLOCK) { }
     bool NotifyBlock(const CBlockIndex *pindex);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
+    CZMQPublishRawTransactionNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_TRANSACTION) { }
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishHashTransactionRemovalNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishHashTransactionRemovalNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_TRANSACTION_REMOVAL) { }
+    bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason);
+};
+
+class CZMQPublishHashBlockDisconnectNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishHashBlockDisconnectNotifier() : CZMQAbstractPublishNotifier(ZMQ_EVENT_BLOCK_DISCONNECT) { }
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H